@@ -0,0 +1,800 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Memory.h"
+#include "Profiler.h"
+#include "Debug.h"
+
+// allocator benchmark, linux only
+// every workload runs in a forked child per heap so peak RSS belongs to that heap alone
+// the child makes an untimed pass for throughput, then a timed pass for per call latency and worst case cycles
+
+namespace ChiroBat
+{
+	namespace Benchmark
+	{
+		struct Options // everything settable from the command line
+		{
+			std::string workload = "all"; // random, lifo, fifo, bins, prodcons, or all
+			std::string trace; // a trace file to replay instead of the synthetic workloads
+			size_t ops = 1000000; // operations per workload
+			size_t live = 10000; // allocations alive at once
+			size_t minSize = 8; // smallest request
+			size_t maxSize = 4096; // largest request
+			size_t poolSize = 1 << 20; // the engine's pool size
+			size_t threads = 1; // producer and consumer pairs
+			size_t seed = 1; // the random seed, runs are deterministic per seed
+			uint64_t maxP999 = 0; // fail if the engine's p999 exceeds this many ns, 0 to skip
+			uint64_t maxLatency = 0; // fail if the engine's worst call exceeds this many ns, 0 to skip
+			uint64_t maxCycles = 0; // fail if the real-time engine's worst call exceeds this many cycles, 0 to skip
+		};
+
+		enum class OpType : byte // the calls a workload makes
+		{
+			Malloc,
+			Free,
+			Realloc
+		};
+
+		struct Op // one call in a workload
+		{
+			OpType type;
+			uint32_t slot; // where the pointer lives in the replay
+			uint32_t size; // the request size, unused by free
+		};
+
+		struct Workload // a single threaded list of calls, replayed the same way on every heap
+		{
+			std::string name;
+			std::vector<Op> ops;
+			size_t slots; // the number of pointer slots the ops use
+		};
+
+		// log-linear latency buckets, exact below 16ns and within 1/16th above
+		struct Histogram
+		{
+			static constexpr int subBits = 4;
+			static constexpr size_t bucketCount = 64 << subBits;
+
+			uint64_t counts[bucketCount];
+			uint64_t total;
+			uint64_t max;
+			uint64_t maxCycles; // the worst call in timestamp counter ticks, rdtsc where there is one
+
+			static size_t bucket(uint64_t ns)
+			{
+				if (ns < (1 << subBits))
+					return (size_t)ns;
+
+				int msb = 63 - __builtin_clzll(ns);
+				return ((size_t)(msb - subBits + 1) << subBits) + ((ns >> (msb - subBits)) & ((1 << subBits) - 1));
+			}
+
+			static uint64_t bucketLimit(size_t index) // the largest latency a bucket holds
+			{
+				if (index < (1 << subBits))
+					return index;
+
+				int shift = (int)(index >> subBits) - 1;
+				return (((uint64_t)(1 << subBits) + (index & ((1 << subBits) - 1)) + 1) << shift) - 1;
+			}
+
+			void add(uint64_t ns, uint64_t cycles)
+			{
+				++counts[bucket(ns)];
+				++total;
+				max = ns > max ? ns : max;
+				maxCycles = cycles > maxCycles ? cycles : maxCycles;
+			}
+
+			void merge(const Histogram& other)
+			{
+				for (size_t i = 0; i < bucketCount; ++i)
+					counts[i] += other.counts[i];
+
+				total += other.total;
+				max = other.max > max ? other.max : max;
+				maxCycles = other.maxCycles > maxCycles ? other.maxCycles : maxCycles;
+			}
+
+			uint64_t percentile(double p)
+			{
+				uint64_t rank = (uint64_t)std::ceil(p * total);
+				uint64_t seen = 0;
+
+				for (size_t i = 0; i < bucketCount; ++i)
+				{
+					seen += counts[i];
+					if (seen >= rank && seen)
+						return bucketLimit(i) < max ? bucketLimit(i) : max;
+				}
+
+				return max;
+			}
+		};
+
+		struct Result // what a child sends back to the parent
+		{
+			double opsPerSecond;
+			size_t baselineRSS; // bytes resident before the heap was touched
+			Histogram latency;
+		};
+
+		// the heaps under test, both expose the same static interface so the replay is compiled once per heap
+
+		struct SystemHeap
+		{
+			static const char* name() { return "system"; }
+			static funcRet init(const Options&, bool) { return EXIT_SUCCESS; }
+			static void shutDown() {}
+			static void* malloc(size_t size) { return ::malloc(size); }
+			static void* realloc(void* pointer, size_t size) { return ::realloc(pointer, size); }
+			static void free(void* pointer) { ::free(pointer); }
+		};
+
+		struct EngineHeap
+		{
+			static const char* name() { return "engine"; }
+			static funcRet init(const Options& options, bool threaded) { return MEMORY.init(options.poolSize, true, threaded); }
+			static void shutDown() { MEMORY.shutDown(); }
+			static void* malloc(size_t size) { return MEMORY.malloc(size); }
+			static void* realloc(void* pointer, size_t size) { return MEMORY.realloc(pointer, size); }
+			static void free(void* pointer) { MEMORY.free(pointer); }
+		};
+
+		struct RealTimeHeap : EngineHeap // the engine's heap with constant time bins
+		{
+			static const char* name() { return "realtime"; }
+
+			static funcRet init(const Options& options, bool threaded)
+			{
+				RET_ON_ERR(EngineHeap::init(options, threaded), EXIT_FAILURE, "[Benchmark] the engine heap failed to initialize");
+				MEMORY.setRealTime(true);
+
+				return EXIT_SUCCESS;
+			}
+		};
+
+		uint64_t now()
+		{
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		size_t residentBytes()
+		{
+			size_t pages = 0, resident = 0;
+
+			FILE* statm = fopen("/proc/self/statm", "r");
+			if (!statm)
+				return 0;
+
+			if (fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+				resident = 0;
+
+			fclose(statm);
+			return resident * (size_t)sysconf(_SC_PAGESIZE);
+		}
+
+		// write to every page of an allocation so both heaps pay for the memory they hand out
+		void touch(void* pointer, size_t size)
+		{
+			byte* data = (byte*)pointer;
+			for (size_t offset = 0; offset < size; offset += 4096)
+				data[offset] = 1;
+
+			data[size - 1] = 1;
+		}
+
+		// request sizes spread evenly over each power of 2 between the limits, as real programs tend to be
+		uint32_t randomSize(std::mt19937_64& rng, const Options& options)
+		{
+			double low = std::log((double)options.minSize), high = std::log((double)options.maxSize + 1);
+			size_t size = (size_t)std::exp(low + (high - low) * std::generate_canonical<double, 53>(rng));
+
+			return (uint32_t)(size < options.minSize ? options.minSize : size > options.maxSize ? options.maxSize : size);
+		}
+
+		// free whatever the ops leave alive, keeping every workload balanced
+		void drain(Workload& workload, std::vector<bool>& live)
+		{
+			for (size_t i = 0; i < live.size(); ++i)
+				if (live[i])
+					workload.ops.push_back({ OpType::Free, (uint32_t)i, 0 });
+		}
+
+		// random mallocs, reallocs, and frees over a fixed set of slots
+		Workload randomWorkload(const Options& options)
+		{
+			Workload workload = { "random", {}, options.live };
+			std::mt19937_64 rng(options.seed);
+			std::vector<bool> live(options.live, false);
+
+			workload.ops.reserve(options.ops + options.live);
+			for (size_t i = 0; i < options.ops; ++i)
+			{
+				uint32_t slot = (uint32_t)(rng() % options.live);
+
+				if (!live[slot])
+					workload.ops.push_back({ OpType::Malloc, slot, randomSize(rng, options) });
+				else if (rng() % 8 == 0)
+					workload.ops.push_back({ OpType::Realloc, slot, randomSize(rng, options) });
+				else
+					workload.ops.push_back({ OpType::Free, slot, 0 });
+
+				live[slot] = workload.ops.back().type != OpType::Free;
+			}
+
+			drain(workload, live);
+			return workload;
+		}
+
+		// fill a stack of allocations, then unwind it in reverse
+		Workload lifoWorkload(const Options& options)
+		{
+			Workload workload = { "lifo", {}, options.live };
+			std::mt19937_64 rng(options.seed);
+
+			workload.ops.reserve(options.ops + options.live);
+			while (workload.ops.size() < options.ops)
+			{
+				for (size_t i = 0; i < options.live; ++i)
+					workload.ops.push_back({ OpType::Malloc, (uint32_t)i, randomSize(rng, options) });
+
+				for (size_t i = options.live; i-- > 0;)
+					workload.ops.push_back({ OpType::Free, (uint32_t)i, 0 });
+			}
+
+			return workload;
+		}
+
+		// a queue of allocations, the oldest is freed as each new one arrives
+		Workload fifoWorkload(const Options& options)
+		{
+			Workload workload = { "fifo", {}, options.live };
+			std::mt19937_64 rng(options.seed);
+			std::vector<bool> live(options.live, false);
+
+			workload.ops.reserve(options.ops + options.live);
+			for (size_t i = 0; workload.ops.size() < options.ops; ++i)
+			{
+				uint32_t slot = (uint32_t)(i % options.live);
+
+				if (live[slot])
+					workload.ops.push_back({ OpType::Free, slot, 0 });
+
+				workload.ops.push_back({ OpType::Malloc, slot, randomSize(rng, options) });
+				live[slot] = true;
+			}
+
+			drain(workload, live);
+			return workload;
+		}
+
+		// long bins, many free blocks of a few close sizes held apart by small allocations, then churn within them
+		// best-fit walks the bin on every call, real-time takes a head or moves up a bin
+		Workload binsWorkload(const Options& options)
+		{
+			Workload workload = { "bins", {}, options.live * 2 };
+			std::mt19937_64 rng(options.seed);
+			std::vector<bool> live(options.live * 2, false);
+
+			// the even slots take the bin's sizes, the odd slots pin them apart, past the slab sizes so they sit between them
+			auto binSize = [&]() { return (uint32_t)(2048 + 8 * (rng() % 4)); };
+
+			workload.ops.reserve(options.ops + options.live * 3);
+			for (size_t i = 0; i < options.live * 2; ++i)
+			{
+				workload.ops.push_back({ OpType::Malloc, (uint32_t)i, i % 2 ? 512 : binSize() });
+				live[i] = true;
+			}
+
+			// free every other block of the bin, none can merge
+			for (size_t i = 0; i < options.live * 2; i += 4)
+			{
+				workload.ops.push_back({ OpType::Free, (uint32_t)i, 0 });
+				live[i] = false;
+			}
+
+			while (workload.ops.size() < options.ops)
+			{
+				uint32_t slot = (uint32_t)(rng() % options.live * 2);
+
+				workload.ops.push_back({ live[slot] ? OpType::Free : OpType::Malloc, slot, live[slot] ? 0 : binSize() });
+				live[slot] = !live[slot];
+			}
+
+			drain(workload, live);
+			return workload;
+		}
+
+		// load a recorded trace, one call per line
+		//   m <id> <size>  malloc
+		//   r <id> <size>  realloc
+		//   f <id>         free
+		// ids are any integers naming an allocation while it is alive, lines starting with # are skipped
+		funcRet traceWorkload(const std::string& path, Workload& workload)
+		{
+			FILE* file = fopen(path.c_str(), "r");
+			RET_ON_ERR(!file, EXIT_FAILURE, "[Benchmark] failed to open the trace %s", path.c_str());
+
+			workload.name = path.substr(path.find_last_of('/') + 1);
+			workload.slots = 0;
+
+			std::unordered_map<unsigned long long, uint32_t> slots; // trace ids to the slots they are alive in
+			std::vector<uint32_t> freeSlots; // slots whose allocation has been freed
+			std::vector<bool> live;
+			size_t skipped = 0;
+
+			char line[256];
+			while (fgets(line, sizeof(line), file))
+			{
+				char type = 0;
+				unsigned long long id = 0;
+				size_t size = 0;
+
+				int fields = sscanf(line, " %c %llu %zu", &type, &id, &size);
+				if (fields < 1 || type == '#')
+					continue;
+
+				auto found = slots.find(id);
+				bool known = found != slots.end();
+
+				if (type == 'm' && fields == 3 && !known)
+				{
+					uint32_t slot;
+					if (freeSlots.empty())
+					{
+						slot = (uint32_t)workload.slots++;
+						live.push_back(false);
+					}
+					else
+					{
+						slot = freeSlots.back();
+						freeSlots.pop_back();
+					}
+
+					slots[id] = slot;
+					live[slot] = true;
+					workload.ops.push_back({ OpType::Malloc, slot, (uint32_t)size });
+				}
+				else if (type == 'r' && fields == 3 && known)
+					workload.ops.push_back({ OpType::Realloc, found->second, (uint32_t)size });
+				else if (type == 'f' && fields >= 2 && known)
+				{
+					workload.ops.push_back({ OpType::Free, found->second, 0 });
+					live[found->second] = false;
+					freeSlots.push_back(found->second);
+					slots.erase(found);
+				}
+				else // malformed, or an id that is not alive
+					++skipped;
+			}
+
+			fclose(file);
+
+			if (skipped)
+			{
+				LOG_ERR("[Benchmark] skipped %zu lines of %s that did not match a live allocation", skipped, path.c_str());
+			}
+
+			drain(workload, live);
+			return EXIT_SUCCESS;
+		}
+
+		// run the calls of a workload against a heap, timing each call when asked
+		template <class Heap, bool Timed>
+		void replay(const Workload& workload, std::vector<void*>& pointers, Histogram& latency)
+		{
+			uint64_t start = 0, startTicks = 0;
+
+			for (const Op& op : workload.ops)
+			{
+				void*& pointer = pointers[op.slot];
+
+				if (Timed)
+				{
+					start = now();
+					startTicks = Profiler::ticks();
+				}
+
+				switch (op.type)
+				{
+				case OpType::Malloc:
+					pointer = Heap::malloc(op.size);
+					break;
+				case OpType::Realloc:
+					if (pointer) // a failed realloc keeps the old allocation
+					{
+						void* resized = Heap::realloc(pointer, op.size);
+						pointer = resized ? resized : pointer;
+					}
+					break;
+				case OpType::Free:
+					if (pointer)
+						Heap::free(pointer);
+					pointer = nullptr;
+					break;
+				}
+
+				if (Timed)
+				{
+					uint64_t ticks = Profiler::ticks() - startTicks;
+					latency.add(now() - start, ticks);
+				}
+
+				if (op.type != OpType::Free && pointer)
+					touch(pointer, op.size);
+			}
+		}
+
+		// run a single threaded workload in this process, called in the child
+		template <class Heap>
+		funcRet runWorkload(const Workload& workload, const Options& options, Result& result)
+		{
+			RET_ON_ERR(Heap::init(options, false), EXIT_FAILURE, "[Benchmark] the %s heap failed to initialize", Heap::name());
+
+			std::vector<void*> pointers(workload.slots, nullptr);
+			result.baselineRSS = residentBytes();
+
+			uint64_t start = now();
+			replay<Heap, false>(workload, pointers, result.latency);
+			result.opsPerSecond = workload.ops.size() / ((now() - start) / 1e9);
+
+			replay<Heap, true>(workload, pointers, result.latency);
+
+			Heap::shutDown();
+			return EXIT_SUCCESS;
+		}
+
+		// a bounded single producer single consumer queue of pointers
+		struct Channel
+		{
+			static constexpr size_t capacity = 1024;
+
+			void* items[capacity];
+			std::atomic<size_t> head; // written by the consumer
+			std::atomic<size_t> tail; // written by the producer
+		};
+
+		// producers allocate and hand the memory to consumers on other threads, which free it
+		template <class Heap>
+		funcRet runProducerConsumer(const Options& options, Result& result)
+		{
+			RET_ON_ERR(Heap::init(options, true), EXIT_FAILURE, "[Benchmark] the %s heap failed to initialize", Heap::name());
+
+			result.baselineRSS = residentBytes();
+
+			size_t pairs = options.threads;
+			size_t perProducer = options.ops / 2 / pairs; // every item is a malloc and a free
+
+			for (int timed = 0; timed < 2; ++timed)
+			{
+				std::vector<Channel> channels(pairs);
+				std::vector<Histogram> latencies(pairs * 2);
+				std::vector<std::thread> threads;
+
+				for (size_t i = 0; i < pairs; ++i)
+				{
+					channels[i].head = channels[i].tail = 0;
+					memset(&latencies[i * 2], 0, sizeof(Histogram) * 2);
+				}
+
+				uint64_t start = now();
+
+				for (size_t i = 0; i < pairs; ++i)
+				{
+					Channel* channel = &channels[i];
+					Histogram* producerLatency = &latencies[i * 2];
+					Histogram* consumerLatency = &latencies[i * 2 + 1];
+
+					threads.emplace_back([=, &options]()
+					{
+						std::mt19937_64 rng(options.seed + i);
+
+						for (size_t n = 0; n < perProducer; ++n)
+						{
+							uint32_t size = randomSize(rng, options);
+
+							uint64_t callStart = timed ? now() : 0, callTicks = timed ? Profiler::ticks() : 0;
+							void* pointer = Heap::malloc(size);
+							if (timed)
+							{
+								uint64_t ticks = Profiler::ticks() - callTicks;
+								producerLatency->add(now() - callStart, ticks);
+							}
+
+							if (pointer)
+								touch(pointer, size);
+
+							size_t tail = channel->tail.load(std::memory_order_relaxed);
+							while (tail - channel->head.load(std::memory_order_acquire) == Channel::capacity)
+								std::this_thread::yield();
+
+							channel->items[tail % Channel::capacity] = pointer;
+							channel->tail.store(tail + 1, std::memory_order_release);
+						}
+					});
+
+					threads.emplace_back([=]()
+					{
+						for (size_t n = 0; n < perProducer; ++n)
+						{
+							size_t head = channel->head.load(std::memory_order_relaxed);
+							while (channel->tail.load(std::memory_order_acquire) == head)
+								std::this_thread::yield();
+
+							void* pointer = channel->items[head % Channel::capacity];
+							channel->head.store(head + 1, std::memory_order_release);
+
+							if (!pointer)
+								continue;
+
+							uint64_t callStart = timed ? now() : 0, callTicks = timed ? Profiler::ticks() : 0;
+							Heap::free(pointer);
+							if (timed)
+							{
+								uint64_t ticks = Profiler::ticks() - callTicks;
+								consumerLatency->add(now() - callStart, ticks);
+							}
+						}
+					});
+				}
+
+				for (std::thread& thread : threads)
+					thread.join();
+
+				if (timed)
+				{
+					for (Histogram& latency : latencies)
+						result.latency.merge(latency);
+				}
+				else
+					result.opsPerSecond = perProducer * pairs * 2 / ((now() - start) / 1e9);
+			}
+
+			Heap::shutDown();
+			return EXIT_SUCCESS;
+		}
+
+		// run a workload on a heap in a child process, so the heaps cannot disturb each others' RSS
+		// workload - the calls to replay, null for producer/consumer
+		template <class Heap>
+		funcRet measure(const Workload* workload, const Options& options, Result& result, size_t& peakRSS)
+		{
+			int channel[2];
+			RET_ON_ERR(pipe(channel), EXIT_FAILURE, "[Benchmark] failed to open a pipe to the child");
+
+			pid_t child = fork();
+			RET_ON_ERR(child < 0, EXIT_FAILURE, "[Benchmark] failed to fork a child for the %s heap", Heap::name());
+
+			if (!child)
+			{
+				close(channel[0]);
+				memset(&result, 0, sizeof(result));
+
+				funcRet state = workload ? runWorkload<Heap>(*workload, options, result) : runProducerConsumer<Heap>(options, result);
+
+				// send the whole result, the pipe may take it in pieces
+				const byte* data = (const byte*)&result;
+				for (size_t sent = 0; !state && sent < sizeof(result);)
+				{
+					ssize_t written = write(channel[1], data + sent, sizeof(result) - sent);
+					if (written <= 0)
+						state = EXIT_FAILURE;
+					else
+						sent += (size_t)written;
+				}
+
+				_exit(state);
+			}
+
+			close(channel[1]);
+
+			byte* data = (byte*)&result;
+			size_t received = 0;
+			for (ssize_t got; received < sizeof(result) && (got = read(channel[0], data + received, sizeof(result) - received)) > 0;)
+				received += (size_t)got;
+
+			close(channel[0]);
+
+			int status;
+			struct rusage usage;
+			RET_ON_ERR(wait4(child, &status, 0, &usage) != child, EXIT_FAILURE, "[Benchmark] lost the child for the %s heap", Heap::name());
+			RET_ON_ERR(!WIFEXITED(status) || WEXITSTATUS(status) || received != sizeof(result), EXIT_FAILURE, "[Benchmark] the %s heap did not finish", Heap::name());
+
+			peakRSS = (size_t)usage.ru_maxrss << 10; // reported in kB
+
+			return EXIT_SUCCESS;
+		}
+
+		template <class Heap>
+		funcRet report(const char* name, const Workload* workload, const Options& options, bool& regressed)
+		{
+			Result result;
+			size_t peakRSS;
+
+			RET_ON_ERR(measure<Heap>(workload, options, result, peakRSS), EXIT_FAILURE, "[Benchmark] %s failed on the %s heap", name, Heap::name());
+
+			Histogram& latency = result.latency;
+			uint64_t p999 = latency.percentile(0.999);
+
+			printf("%-16s %-8s %10.2f %8llu %8llu %8llu %10llu %10llu %12zu %12zu\n", name, Heap::name(), result.opsPerSecond / 1e6,
+				(unsigned long long)latency.percentile(0.5), (unsigned long long)latency.percentile(0.99), (unsigned long long)p999,
+				(unsigned long long)latency.max, (unsigned long long)latency.maxCycles, peakRSS >> 10, (peakRSS > result.baselineRSS ? peakRSS - result.baselineRSS : 0) >> 10);
+
+			// only the engine's numbers gate a merge
+			if (strcmp(Heap::name(), SystemHeap::name()))
+			{
+				if (options.maxP999 && p999 > options.maxP999)
+				{
+					printf("  p999 of %llu ns is over the limit of %llu ns\n", (unsigned long long)p999, (unsigned long long)options.maxP999);
+					regressed = true;
+				}
+
+				if (options.maxLatency && latency.max > options.maxLatency)
+				{
+					printf("  worst call of %llu ns is over the limit of %llu ns\n", (unsigned long long)latency.max, (unsigned long long)options.maxLatency);
+					regressed = true;
+				}
+			}
+
+			// the real-time heap promises a bound, best-fit does not
+			if (!strcmp(Heap::name(), RealTimeHeap::name()) && options.maxCycles && latency.maxCycles > options.maxCycles)
+			{
+				printf("  worst call of %llu cycles is over the limit of %llu cycles\n", (unsigned long long)latency.maxCycles, (unsigned long long)options.maxCycles);
+				regressed = true;
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet compare(const char* name, const Workload* workload, const Options& options, bool& regressed)
+		{
+			RET_ON_ERR(report<SystemHeap>(name, workload, options, regressed), EXIT_FAILURE, "[Benchmark] %s was not measured", name);
+			RET_ON_ERR(report<EngineHeap>(name, workload, options, regressed), EXIT_FAILURE, "[Benchmark] %s was not measured", name);
+			RET_ON_ERR(report<RealTimeHeap>(name, workload, options, regressed), EXIT_FAILURE, "[Benchmark] %s was not measured", name);
+
+			return EXIT_SUCCESS;
+		}
+
+		void usage()
+		{
+			printf(
+				"usage: benchmark [options]\n"
+				"  --workload <name>     random, lifo, fifo, bins, prodcons, or all (default all)\n"
+				"  --trace <file>        replay a recorded trace instead of the synthetic workloads\n"
+				"  --ops <n>             operations per workload (default 1000000)\n"
+				"  --live <n>            allocations alive at once (default 10000)\n"
+				"  --min-size <bytes>    smallest request (default 8)\n"
+				"  --max-size <bytes>    largest request (default 4096)\n"
+				"  --pool <bytes>        engine pool size (default 1048576)\n"
+				"  --threads <n>         producer/consumer pairs (default 1)\n"
+				"  --seed <n>            random seed (default 1)\n"
+				"  --max-p999 <ns>       exit with failure if the engine's p999 latency is above this\n"
+				"  --max-latency <ns>    exit with failure if the engine's worst call is above this\n"
+				"  --max-cycles <n>      exit with failure if the real-time engine's worst call takes more cycles than this\n"
+				"trace lines are 'm <id> <size>', 'r <id> <size>', or 'f <id>'\n");
+		}
+
+		funcRet parse(int argc, char** argv, Options& options)
+		{
+			for (int i = 1; i < argc; ++i)
+			{
+				std::string flag = argv[i];
+
+				if (flag == "--help" || flag == "-h")
+					return EXIT_FAILURE;
+
+				RET_ON_ERR(i + 1 >= argc, EXIT_FAILURE, "[Benchmark] %s needs a value", flag.c_str());
+				const char* value = argv[++i];
+
+				if (flag == "--workload")
+					options.workload = value;
+				else if (flag == "--trace")
+					options.trace = value;
+				else if (flag == "--ops")
+					options.ops = strtoull(value, nullptr, 0);
+				else if (flag == "--live")
+					options.live = strtoull(value, nullptr, 0);
+				else if (flag == "--min-size")
+					options.minSize = strtoull(value, nullptr, 0);
+				else if (flag == "--max-size")
+					options.maxSize = strtoull(value, nullptr, 0);
+				else if (flag == "--pool")
+					options.poolSize = strtoull(value, nullptr, 0);
+				else if (flag == "--threads")
+					options.threads = strtoull(value, nullptr, 0);
+				else if (flag == "--seed")
+					options.seed = strtoull(value, nullptr, 0);
+				else if (flag == "--max-p999")
+					options.maxP999 = strtoull(value, nullptr, 0);
+				else if (flag == "--max-latency")
+					options.maxLatency = strtoull(value, nullptr, 0);
+				else if (flag == "--max-cycles")
+					options.maxCycles = strtoull(value, nullptr, 0);
+				else
+				{
+					LOG_ERR("[Benchmark] unknown option %s", flag.c_str());
+					return EXIT_FAILURE;
+				}
+			}
+
+			RET_ON_ERR(!options.ops || !options.live || !options.threads, EXIT_FAILURE, "[Benchmark] ops, live, and threads must be above 0");
+			RET_ON_ERR(!options.minSize || options.minSize > options.maxSize || options.maxSize > UINT32_MAX, EXIT_FAILURE, "[Benchmark] sizes must be within 1 and %u, smallest first", UINT32_MAX);
+
+			return EXIT_SUCCESS;
+		}
+	}
+}
+
+using namespace ChiroBat::Benchmark;
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (parse(argc, argv, options))
+	{
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	bool regressed = false;
+	bool all = options.workload == "all";
+	bool ran = false;
+
+	printf("%-16s %-8s %10s %8s %8s %8s %10s %10s %12s %12s\n", "workload", "heap", "Mops/s", "p50 ns", "p99 ns", "p999 ns", "max ns", "max cyc", "peak KiB", "heap KiB");
+
+	if (!options.trace.empty())
+	{
+		Workload workload;
+		if (traceWorkload(options.trace, workload) || compare(workload.name.c_str(), &workload, options, regressed))
+			return EXIT_FAILURE;
+
+		ran = true;
+	}
+	else
+	{
+		struct
+		{
+			const char* name;
+			Workload (*generate)(const Options&);
+		} generators[] = { { "random", randomWorkload }, { "lifo", lifoWorkload }, { "fifo", fifoWorkload }, { "bins", binsWorkload } };
+
+		for (auto& generator : generators)
+		{
+			if (!all && options.workload != generator.name)
+				continue;
+
+			Workload workload = generator.generate(options);
+			if (compare(generator.name, &workload, options, regressed))
+				return EXIT_FAILURE;
+
+			ran = true;
+		}
+
+		if (all || options.workload == "prodcons")
+		{
+			if (compare("prodcons", nullptr, options, regressed))
+				return EXIT_FAILURE;
+
+			ran = true;
+		}
+	}
+
+	if (!ran)
+	{
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
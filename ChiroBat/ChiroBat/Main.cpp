@@ -4,6 +4,13 @@
 
 using namespace ChiroBat;
 
+// end the main loop once a second has been simulated
+void stopAfterSecond(const Engine::FrameContext& context, void*)
+{
+	if (context.time >= 1.0)
+		ENGINE.stop();
+}
+
 int main()
 {
 	funcRet engineState;
@@ -47,6 +54,12 @@ int main()
 	if (data) MEMORY.free(data);
 	if (data2) MEMORY.free(data2);
 
+	engineState = ENGINE.addHook(Engine::Stage::Update, stopAfterSecond, nullptr);
+	RET_ON_ERR(engineState, EXIT_FAILURE, "[Main] Engine failed to add a hook");
+
+	engineState = ENGINE.run();
+	RET_ON_ERR(engineState, EXIT_FAILURE, "[Main] Engine main loop failed");
+
 	engineState = ENGINE.shutDown();
 	RET_ON_ERR(engineState, EXIT_FAILURE, "[Main] Engine failed to shutdown");
 
@@ -9,7 +9,19 @@
 
 #if( defined DEBUG || defined _DEBUG)
 
-#define LOG_ERR(string, ...) fprintf(stderr, string, ##__VA_ARGS__); fprintf(stderr, "\n")
+#include "Log.h"
+
+// log a record through the asynchronous logger, each call site keeps its own rate limit
+#define LOG_AT(severity, string, ...) \
+do {\
+	static ChiroBat::Log::Site logSite;\
+	ChiroBat::Log::write(severity, logSite, string, ##__VA_ARGS__);\
+}while (0)
+
+#define LOG_ERR(string, ...) LOG_AT(ChiroBat::Log::Severity::Error, string, ##__VA_ARGS__)
+#define LOG_WARN(string, ...) LOG_AT(ChiroBat::Log::Severity::Warning, string, ##__VA_ARGS__)
+#define LOG_INFO(string, ...) LOG_AT(ChiroBat::Log::Severity::Info, string, ##__VA_ARGS__)
+#define LOG_DEBUG(string, ...) LOG_AT(ChiroBat::Log::Severity::Debug, string, ##__VA_ARGS__)
 
 #define RET_ON_ERR(funcRet, errRet, string, ...) \
 do {\
@@ -32,6 +44,9 @@ if (funcRet < 0)\
 #else
 
 #define LOG_ERR(string, ...)
+#define LOG_WARN(string, ...)
+#define LOG_INFO(string, ...)
+#define LOG_DEBUG(string, ...)
 
 #define RET_ON_ERR(funcRet, errRet, string, ...) \
 do {\
@@ -47,4 +62,20 @@ if (funcRet < 0)\
 
 #endif
 
+// time the enclosing scope, compiled out unless CHIROBAT_PROFILE is defined, the name still counts as used
+
+#if defined CHIROBAT_PROFILE
+
+#include "Profiler.h"
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ChiroBat::Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#else
+
+#define PROFILE_SCOPE(name) (void)sizeof(name)
+
+#endif
+
 #endif
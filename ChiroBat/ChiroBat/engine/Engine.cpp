@@ -1,6 +1,13 @@
+#include <chrono>
+#include <cmath>
+#include <thread>
 #include "Engine.h"
 #include "Debug.h"
 #include "Memory.h"
+#include "FrameArena.h"
+#include "Jobs.h"
+#include "Log.h"
+#include "Streaming.h"
 
 namespace ChiroBat
 {
@@ -9,21 +16,182 @@ namespace ChiroBat
 		funcRet Engine::init()
 		{
 			funcRet systemState;
-			
-			systemState = MEMORY.init(1024, true);
+
+#if( defined DEBUG || defined _DEBUG)
+			// logging leaves the callers' paths from here on, until then it is written as it happens
+			systemState = Log::start();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Log failed to start");
+#endif
+
+			// thread caches let every worker allocate without contending for the heap
+			// the pools are sized so both frame arenas below are carved from the first one
+			systemState = MEMORY.init(1 << 23, true, true);
 			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Memory failed to initialize");
 
+			systemState = FRAME_MEMORY.init(1 << 22, 2);
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Frame memory failed to initialize");
+
+			systemState = JOBS.init();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Jobs failed to initialize");
+
+			systemState = STREAMING.init();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Streaming failed to initialize");
+
 			return EXIT_SUCCESS;
 		}
 
 		funcRet Engine::shutDown()
 		{
 			funcRet systemState;
+
+			systemState = STREAMING.shutDown();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Streaming failed to shutdown");
+
+			systemState = JOBS.shutDown();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Jobs failed to shutdown");
+
+			systemState = FRAME_MEMORY.shutDown();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Frame memory failed to shutdown");
 			
 			systemState = MEMORY.shutDown();
 			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Memory failed to shutdown");
-			
+
+#if( defined DEBUG || defined _DEBUG)
+			systemState = Log::stop();
+			RET_ON_ERR(systemState, EXIT_FAILURE, "[Engine] Log failed to stop");
+#endif
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet Engine::addHook(Stage stage, FrameHook hook, void* user)
+		{
+			RET_ON_ERR(stage >= Stage::Count || !hook, EXIT_FAILURE, "[Engine] an invalid hook was added to stage %d", (int)stage);
+
+			byte& count = hookCount[(size_t)stage];
+			RET_ON_ERR(count == maxHooks, EXIT_FAILURE, "[Engine] stage %d already holds %d hooks", (int)stage, maxHooks);
+
+			hooks[(size_t)stage][count++] = Hook{ hook, user };
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet Engine::removeHook(Stage stage, FrameHook hook, void* user)
+		{
+			RET_ON_ERR(stage >= Stage::Count, EXIT_FAILURE, "[Engine] a hook was removed from invalid stage %d", (int)stage);
+
+			Hook* stageHooks = hooks[(size_t)stage];
+			byte& count = hookCount[(size_t)stage];
+
+			byte i = 0;
+			while (i < count && (stageHooks[i].function != hook || stageHooks[i].user != user))
+				++i;
+
+			RET_ON_ERR(i == count, EXIT_FAILURE, "[Engine] a hook that was never added to stage %d was removed", (int)stage);
+
+			// shift the rest down, the order they run in is kept
+			for (--count; i < count; ++i)
+				stageHooks[i] = stageHooks[i + 1];
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet Engine::run(double step)
+		{
+			RET_ON_ERR(!(step > 0.0), EXIT_FAILURE, "[Engine] a fixed step of %f seconds was requested", step);
+			RET_ON_ERR(!JOBS.workers(), EXIT_FAILURE, "[Engine] the main loop was run before the engine was initialized");
+
+			typedef std::chrono::steady_clock Clock;
+
+			FrameContext context = {};
+			context.step = step;
+
+			Jobs::Counter rendered; // the render of the previous frame
+			bool published = false; // true once there is a frame to render
+			double lag = 0.0; // real seconds not simulated yet
+			Clock::time_point last = Clock::now();
+
+			running = true;
+			while (running.load(std::memory_order_acquire))
+			{
+				Clock::time_point now = Clock::now();
+				lag += std::chrono::duration<double>(now - last).count();
+				last = now;
+
+				// with less than a step to run the frame would publish the same state again, wait for the step instead of spinning
+				if (lag < step)
+				{
+					double idle = step - lag - wakeMargin;
+					if (idle > 0.0)
+						std::this_thread::sleep_for(std::chrono::duration<double>(idle));
+					else
+						std::this_thread::yield();
+
+					continue;
+				}
+
+				// render the last published frame while this one simulates, it only reads the other slot
+				if (published && JOBS.run(renderJob, this, &rendered))
+					renderJob(this); // the job could not be queued, render before simulating instead
+
+				// catch up in fixed steps, past the limit the time is dropped rather than spiralling
+				byte steps;
+				for (steps = 0; lag >= step && steps < maxSteps; ++steps)
+				{
+					context.alpha = 0.0;
+					runStage(Stage::Update, context);
+
+					context.time += step;
+					lag -= step;
+				}
+
+				if (lag >= step)
+					lag = fmod(lag, step);
+
+				context.alpha = lag / step;
+				runStage(Stage::Publish, context);
+
+				// the render must be done with its slot before this frame's slot is handed to the next one
+				JOBS.wait(&rendered);
+
+				renderContext = context;
+				published = true;
+
+				++context.frame;
+				context.slot ^= 1;
+
+				endFrame();
+			}
+
 			return EXIT_SUCCESS;
 		}
+
+		void Engine::stop()
+		{
+			running.store(false, std::memory_order_release);
+		}
+
+		void Engine::endFrame()
+		{
+			FRAME_MEMORY.nextFrame();
+		}
+
+		void Engine::runStage(Stage stage, const FrameContext& context)
+		{
+			static const char* const stageNames[(size_t)Stage::Count] = { "Engine::Update", "Engine::Publish", "Engine::Render" };
+			PROFILE_SCOPE(stageNames[(size_t)stage]);
+
+			const Hook* stageHooks = hooks[(size_t)stage];
+			byte count = hookCount[(size_t)stage];
+
+			for (byte i = 0; i < count; ++i)
+				stageHooks[i].function(context, stageHooks[i].user);
+		}
+
+		void Engine::renderJob(void* engine)
+		{
+			Engine* self = (Engine*)engine;
+			self->runStage(Stage::Render, self->renderContext);
+		}
 	}
 }
\ No newline at end of file
@@ -1,20 +1,88 @@
 #ifndef CHIROBAT_ENGINE
 #define CHIROBAT_ENGINE
 
+#include <atomic>
 #include "Types.h"
 #include "Patterns.h"
 
 #define ENGINE ChiroBat::Engine::Engine::instance()
 
+// the main loop runs the simulation at a fixed step and renders once per frame, a frame waits until there is a step to run
+// rendering a frame overlaps the simulation of the next one, they meet through double-buffered frame state
+// Update - runs once per fixed step on the main thread, on the subsystem's live state
+// Publish - runs once per frame after the steps, copies what rendering needs into the frame state slot it is given
+// Render - runs on a worker alongside the next frame's Update and Publish, reads only the slot it is given
+
 namespace ChiroBat
 {
 	namespace Engine
 	{
+		enum class Stage : byte // where in the frame a hook runs
+		{
+			Update, // every fixed step
+			Publish, // once the frame's steps are done
+			Render, // a frame later, alongside the next simulation
+			Count // the number of stages, not a stage
+		};
+
+		struct FrameContext // what a hook is told about its frame
+		{
+			size_t frame; // the frame being simulated, published, or rendered
+			double step; // the fixed simulation step in seconds
+			double time; // the simulated seconds, at the start of the step for Update and after the frame's steps otherwise
+			double alpha; // how far real time has run past the published state, in steps from 0 to 1, for interpolation
+			byte slot; // the frame state to write in Publish and to read in Render, 0 or 1
+		};
+
+		typedef void(*FrameHook)(const FrameContext& context, void* user); // a stage of a subsystem, user is what it was added with
+
 		class Engine : public Patterns::Singleton<Engine>
 		{
 		public:
+			static constexpr byte maxHooks = 16; // the hooks each stage can hold
+			static constexpr byte maxSteps = 5; // the steps a frame may run to catch up, slower machines fall behind rather than spiral
+			static constexpr double wakeMargin = 0.002; // the seconds before the next step a waiting frame wakes at, sleeps overshoot and it yields the rest
+
 			funcRet init();
 			funcRet shutDown();
+
+			// add a hook to a stage, hooks in a stage run in the order added
+			// stage - the stage to run in
+			// hook - the function to run
+			// user - passed to the hook
+			funcRet addHook(Stage stage, FrameHook hook, void* user);
+
+			// remove a hook, not while the loop is running
+			// stage - the stage it was added to
+			// hook - the function it was added with
+			// user - what it was added with
+			funcRet removeHook(Stage stage, FrameHook hook, void* user);
+
+			// run the main loop until stop is called
+			// step - the fixed simulation step in seconds
+			funcRet run(double step = 1.0 / 60.0);
+			void stop(); // end the main loop after the current frame, safe from any hook or thread
+
+			void endFrame(); // finish the current frame, rotating the per-frame memory
+
+		private:
+			struct Hook
+			{
+				FrameHook function; // the function to run
+				void* user; // passed to the function
+			};
+
+			Hook hooks[(size_t)Stage::Count][maxHooks]; // the hooks of each stage
+			byte hookCount[(size_t)Stage::Count]; // the hooks in use in each stage
+			std::atomic<bool> running; // cleared to end the main loop
+
+			FrameContext renderContext; // the context of the frame being rendered
+
+			// run every hook of a stage
+			// stage - the stage to run
+			// context - passed to every hook
+			void runStage(Stage stage, const FrameContext& context);
+			static void renderJob(void* engine); // render the published frame, run as a job
 		};
 	}
 }
@@ -0,0 +1,298 @@
+#include <new>
+#include <atomic>
+#include <string.h>
+#include "Entities.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Entities
+	{
+		static size_t componentSizes[maxComponents]; // the bytes of each component type, by id
+		static std::atomic<size_t> componentCount(0); // the ids handed out
+
+		byte registerComponent(size_t size)
+		{
+			size_t id = componentCount.fetch_add(1, std::memory_order_relaxed);
+			RET_ON_ERR(id >= maxComponents, maxComponents, "[Entities] more than %d component types were registered", maxComponents);
+
+			componentSizes[id] = size;
+
+			return (byte)id;
+		}
+
+		// the next id in a mask, from the lowest
+		// mask - the ids left, the id found is cleared
+		static byte nextId(uint64_t& mask)
+		{
+			byte ret = 0;
+			while (!(mask & ((uint64_t)1 << ret)))
+				++ret;
+
+			mask &= mask - 1;
+
+			return ret;
+		}
+
+		World::World() : entityCount(0)
+		{
+		}
+
+		funcRet World::init()
+		{
+			// prevent over-initialization
+			RET_ON_ERR(!archetypes.empty(), EXIT_FAILURE, "[Entities] re-initialization of the world was attempted");
+
+			// every entity starts out in the empty archetype
+			RET_ON_ERR(!findArchetype(0), EXIT_FAILURE, "[Entities] failed to make the empty archetype");
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet World::shutDown()
+		{
+			// there is nothing to shut down if this is true
+			RET_ON_ERR(archetypes.empty(), EXIT_FAILURE, "[Entities] shutdown of the non-initialized world was attempted");
+
+			for (Archetype* archetype : archetypes)
+			{
+				for (Chunk* chunk : archetype->chunks)
+					MEMORY.free(chunk, Memory::Tag::Entities);
+
+				archetype->~Archetype();
+				MEMORY.free(archetype, Memory::Tag::Entities);
+			}
+
+			// swap the arrays out, clearing alone keeps their memory
+			Array<Archetype*>().swap(archetypes);
+			Map<uint64_t, Archetype*>().swap(archetypeMasks);
+			Array<Record>().swap(records);
+			Array<uint32_t>().swap(freeSlots);
+			entityCount = 0;
+
+			return EXIT_SUCCESS;
+		}
+
+		Entity World::create()
+		{
+			RET_ON_ERR(archetypes.empty(), noEntity, "[Entities] an entity was created in the non-initialized world");
+
+			// reuse a destroyed entity's slot, its generation was bumped when it was destroyed
+			uint32_t index;
+			if (!freeSlots.empty())
+			{
+				index = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			else
+			{
+				RET_ON_ERR(records.size() >= noEntity.index, noEntity, "[Entities] the world is out of entity slots");
+
+				index = (uint32_t)records.size();
+				records.push_back(Record{ nullptr, 0, 0 });
+			}
+
+			Record& record = records[index];
+
+			if (allocateRow(archetypes[0], record.chunk, record.row))
+			{
+				freeSlots.push_back(index);
+				return noEntity;
+			}
+
+			Entity ret = { index, record.generation };
+			((Entity*)entities(record.chunk))[record.row] = ret;
+			++entityCount;
+
+			return ret;
+		}
+
+		funcRet World::destroy(Entity entity)
+		{
+			RET_ON_ERR(!alive(entity), EXIT_FAILURE, "[Entities] a dead entity was destroyed");
+
+			Record& record = records[entity.index];
+			freeRow(record.chunk, record.row);
+
+			// stale handles to the slot stop matching it
+			record.chunk = nullptr;
+			++record.generation;
+			freeSlots.push_back(entity.index);
+			--entityCount;
+
+			return EXIT_SUCCESS;
+		}
+
+		bool World::alive(Entity entity)
+		{
+			return entity.index < records.size() && records[entity.index].chunk && records[entity.index].generation == entity.generation;
+		}
+
+		size_t World::count()
+		{
+			return entityCount;
+		}
+
+		World::Archetype* World::findArchetype(uint64_t mask)
+		{
+			Map<uint64_t, Archetype*>::iterator found = archetypeMasks.find(mask);
+			if (found != archetypeMasks.end())
+				return found->second;
+
+			// every column may need up to a line of padding, the header takes a line of its own
+			size_t columns = 1;
+			size_t rowSize = sizeof(Entity);
+			for (uint64_t ids = mask; ids; ++columns)
+				rowSize += componentSizes[nextId(ids)];
+
+			size_t capacity = (chunkSize - lineSize * (columns + 1)) / rowSize;
+			RET_ON_ERR(!capacity, nullptr, "[Entities] a row of %zu bytes does not fit a chunk", rowSize);
+
+			Archetype* ret = (Archetype*)MEMORY.malloc(sizeof(Archetype), Memory::Tag::Entities);
+			RET_ON_ERR(!ret, nullptr, "[Entities] failed to allocate an archetype");
+
+			new (ret) Archetype();
+			ret->mask = mask;
+			ret->capacity = (uint32_t)capacity;
+
+			// lay the columns out after the entity column, each on its own line
+			size_t offset = lineSize + ((capacity * sizeof(Entity) + lineSize - 1) & ~(lineSize - 1));
+			for (uint64_t ids = mask; ids;)
+			{
+				byte id = nextId(ids);
+				ret->offsets[id] = (uint32_t)offset;
+				offset += (capacity * componentSizes[id] + lineSize - 1) & ~(lineSize - 1);
+			}
+
+			archetypes.push_back(ret);
+			archetypeMasks.emplace(mask, ret);
+
+			return ret;
+		}
+
+		funcRet World::allocateRow(Archetype* archetype, Chunk*& chunk, uint32_t& row)
+		{
+			// only the last chunk has room, the rest are kept full
+			if (archetype->chunks.empty() || archetype->chunks.back()->count == archetype->capacity)
+			{
+				Chunk* added = (Chunk*)MEMORY.alignMalloc(chunkSize, lineSize, Memory::Tag::Entities);
+				RET_ON_ERR(!added, EXIT_FAILURE, "[Entities] failed to allocate a chunk");
+
+				added->archetype = archetype;
+				added->count = 0;
+				archetype->chunks.push_back(added);
+			}
+
+			chunk = archetype->chunks.back();
+			row = chunk->count++;
+
+			return EXIT_SUCCESS;
+		}
+
+		void World::freeRow(Chunk* chunk, uint32_t row)
+		{
+			Archetype* archetype = chunk->archetype;
+			Chunk* last = archetype->chunks.back();
+			uint32_t lastRow = last->count - 1;
+
+			// fill the hole with the archetype's last entity
+			if (last != chunk || lastRow != row)
+			{
+				Entity moved = entities(last)[lastRow];
+				((Entity*)entities(chunk))[row] = moved;
+
+				for (uint64_t ids = archetype->mask; ids;)
+				{
+					byte id = nextId(ids);
+					size_t size = componentSizes[id];
+					memcpy((byte*)chunk + archetype->offsets[id] + row * size, (byte*)last + archetype->offsets[id] + lastRow * size, size);
+				}
+
+				records[moved.index].chunk = chunk;
+				records[moved.index].row = row;
+			}
+
+			// an emptied chunk goes straight back
+			if (!--last->count)
+			{
+				archetype->chunks.pop_back();
+				MEMORY.free(last, Memory::Tag::Entities);
+			}
+		}
+
+		funcRet World::moveEntity(Record& record, Archetype* to)
+		{
+			Chunk* from = record.chunk;
+			uint32_t fromRow = record.row;
+
+			Chunk* chunk;
+			uint32_t row;
+			RET_ON_ERR(allocateRow(to, chunk, row), EXIT_FAILURE, "[Entities] failed to make room for a moved entity");
+
+			((Entity*)entities(chunk))[row] = entities(from)[fromRow];
+
+			// the components both archetypes have come along, an added one is left for the caller
+			Archetype* fromArchetype = from->archetype;
+			for (uint64_t ids = fromArchetype->mask & to->mask; ids;)
+			{
+				byte id = nextId(ids);
+				size_t size = componentSizes[id];
+				memcpy((byte*)chunk + to->offsets[id] + row * size, (byte*)from + fromArchetype->offsets[id] + fromRow * size, size);
+			}
+
+			freeRow(from, fromRow);
+
+			record.chunk = chunk;
+			record.row = row;
+
+			return EXIT_SUCCESS;
+		}
+
+		void* World::addComponent(Entity entity, byte id)
+		{
+			RET_ON_ERR(id >= maxComponents, nullptr, "[Entities] a component with no id was added");
+			RET_ON_ERR(!alive(entity), nullptr, "[Entities] a component was added to a dead entity");
+
+			Record& record = records[entity.index];
+			uint64_t mask = record.chunk->archetype->mask | (uint64_t)1 << id;
+
+			if (mask != record.chunk->archetype->mask)
+			{
+				Archetype* to = findArchetype(mask);
+				if (!to || moveEntity(record, to))
+					return nullptr;
+			}
+
+			return (byte*)record.chunk + record.chunk->archetype->offsets[id] + record.row * componentSizes[id];
+		}
+
+		funcRet World::removeComponent(Entity entity, byte id)
+		{
+			RET_ON_ERR(id >= maxComponents, EXIT_FAILURE, "[Entities] a component with no id was removed");
+			RET_ON_ERR(!alive(entity), EXIT_FAILURE, "[Entities] a component was removed from a dead entity");
+
+			Record& record = records[entity.index];
+			uint64_t mask = record.chunk->archetype->mask & ~((uint64_t)1 << id);
+
+			RET_ON_ERR(mask == record.chunk->archetype->mask, EXIT_FAILURE, "[Entities] a component the entity does not have was removed");
+
+			Archetype* to = findArchetype(mask);
+			if (!to)
+				return EXIT_FAILURE;
+
+			return moveEntity(record, to);
+		}
+
+		void* World::getComponent(Entity entity, byte id)
+		{
+			if (id >= maxComponents || !alive(entity))
+				return nullptr;
+
+			Record& record = records[entity.index];
+			if (!(record.chunk->archetype->mask & (uint64_t)1 << id))
+				return nullptr;
+
+			return (byte*)record.chunk + record.chunk->archetype->offsets[id] + record.row * componentSizes[id];
+		}
+	}
+}
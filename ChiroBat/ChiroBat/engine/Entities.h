@@ -0,0 +1,251 @@
+#ifndef CHIROBAT_ENTITIES
+#define CHIROBAT_ENTITIES
+
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "Types.h"
+#include "Memory.h"
+#include "MemoryResource.h"
+#include "Jobs.h"
+
+// an archetype entity component system
+// entities with the same set of components share an archetype, whose chunks hold them structure of arrays
+// a chunk is chunkSize bytes from the memory manager, every column in it starts on a cache line
+// the chunks of an archetype stay packed, all are full but the last, so a query walks dense arrays
+// components are plain data, moved with memcpy when an entity changes archetype
+// create, destroy, add, and remove move entities, pointers from get or a query last until the next of them
+// not thread safe, structural changes belong to one thread, queries may run their chunks across the job system
+
+namespace ChiroBat
+{
+	namespace Entities
+	{
+		struct Entity // a handle to an entity, stale once the entity is destroyed
+		{
+			uint32_t index; // the entity's slot in the world
+			uint32_t generation; // the slot's use, bumped when its entity is destroyed
+		};
+
+		inline bool operator==(Entity a, Entity b) { return a.index == b.index && a.generation == b.generation; }
+		inline bool operator!=(Entity a, Entity b) { return !(a == b); }
+
+		static constexpr Entity noEntity = { ~(uint32_t)0, 0 }; // never alive, returned when an entity cannot be created
+
+		static constexpr byte maxComponents = 64; // the component types a process may register
+		static constexpr size_t chunkSize = 16384; // the bytes of a chunk
+		static constexpr size_t lineSize = 64; // the alignment of every column
+
+		// register a component type, use componentId instead
+		// size - the bytes of the type
+		// returns the type's id, maxComponents if there is no room left
+		byte registerComponent(size_t size);
+
+		// the id of a component type, registered on first use
+		template <class T>
+		byte componentId()
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "components are moved with memcpy");
+			static_assert(alignof(T) <= lineSize, "components are aligned to at most a cache line");
+
+			static const byte id = registerComponent(sizeof(T));
+			return id;
+		}
+
+		class World
+		{
+		public:
+			World();
+
+			funcRet init(); // initialize the world, the memory manager must be initialized
+			funcRet shutDown(); // destroy every entity and release the chunks
+
+			Entity create(); // create an entity with no components, noEntity on failure
+			funcRet destroy(Entity entity); // destroy an entity and its components
+			bool alive(Entity entity); // true if the entity was created and not destroyed
+			size_t count(); // the entities alive
+
+			// add a component, or overwrite it if the entity already has one
+			// entity - the entity to add to
+			// value - the component's value
+			// returns the component, nullptr on failure
+			template <class T>
+			T* add(Entity entity, const T& value = T())
+			{
+				T* ret = (T*)addComponent(entity, componentId<T>());
+				if (ret)
+					*ret = value;
+
+				return ret;
+			}
+
+			// remove a component
+			// entity - the entity to remove from
+			template <class T>
+			funcRet remove(Entity entity)
+			{
+				return removeComponent(entity, componentId<T>());
+			}
+
+			// get a component
+			// entity - the entity to look in
+			// returns the component, nullptr if the entity does not have one
+			template <class T>
+			T* get(Entity entity)
+			{
+				return (T*)getComponent(entity, componentId<T>());
+			}
+
+			// run a function on every chunk of entities with all of the components Ts
+			// function - called as function(size_t count, const Entity* entities, Ts*... columns), each array count long
+			template <class... Ts, class F>
+			void each(F function)
+			{
+				uint64_t mask;
+				if (componentMask<Ts...>(mask)) // a type with no id is on no entity
+					return;
+
+				for (Archetype* archetype : archetypes)
+				{
+					if ((archetype->mask & mask) != mask)
+						continue;
+
+					for (Chunk* chunk : archetype->chunks)
+						function((size_t)chunk->count, entities(chunk), column<Ts>(chunk)...);
+				}
+			}
+
+			// each, with the chunks spread across the job system, returns once every chunk is done, EXIT_FAILURE if a type has no id
+			// function - called as in each, from any worker, on one chunk at a time
+			template <class... Ts, class F>
+			funcRet parallelEach(F function)
+			{
+				uint64_t mask;
+				if (componentMask<Ts...>(mask))
+					return EXIT_FAILURE;
+
+				Array<Chunk*> chunks;
+				for (Archetype* archetype : archetypes)
+					if ((archetype->mask & mask) == mask)
+						chunks.insert(chunks.end(), archetype->chunks.begin(), archetype->chunks.end());
+
+				ChunkQuery<F> query = { &function, chunks.data() };
+				return JOBS.parallelFor(chunks.size(), 1, &World::runChunks<F, Ts...>, &query);
+			}
+
+		private:
+			template <class T>
+			using Array = std::vector<T, Memory::Allocator<T, Memory::Tag::Entities>>; // a growable array on the memory manager
+
+			template <class K, class V>
+			using Map = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Memory::Allocator<std::pair<const K, V>, Memory::Tag::Entities>>; // a hash map on the memory manager
+
+			struct Archetype;
+
+			struct Chunk // the header of a chunk, the entity column starts a line in and the component columns follow
+			{
+				Archetype* archetype; // the archetype the chunk belongs to
+				uint32_t count; // the entities in the chunk
+			};
+
+			struct Archetype // the entities with one set of components
+			{
+				uint64_t mask; // a bit for each component id in the set
+				uint32_t capacity; // the entities a chunk holds
+				uint32_t offsets[maxComponents]; // where each component's column starts in a chunk, by id
+				Array<Chunk*> chunks; // full chunks, then the one being filled
+			};
+
+			struct Record // where an entity lives
+			{
+				Chunk* chunk; // the entity's chunk, nullptr while the slot is free
+				uint32_t row; // the entity's row in the chunk
+				uint32_t generation; // the slot's use
+			};
+
+			template <class F>
+			struct ChunkQuery // a parallelEach in flight
+			{
+				F* function; // the function to run
+				Chunk* const* chunks; // every matching chunk
+			};
+
+			Array<Archetype*> archetypes; // every archetype made so far, the empty one first
+			Map<uint64_t, Archetype*> archetypeMasks; // every archetype by its mask, so a structural change does not scan them all
+			Array<Record> records; // every entity slot, by index
+			Array<uint32_t> freeSlots; // the slots of destroyed entities
+			size_t entityCount; // the entities alive
+
+			// set a component's bit in a mask
+			// mask - the mask to add to
+			// id - the component's id
+			// returns false if the id is maxComponents, the type was registered with no room left and has no bit
+			static bool maskId(uint64_t& mask, byte id)
+			{
+				if (id >= maxComponents)
+					return false;
+
+				mask |= (uint64_t)1 << id;
+				return true;
+			}
+
+			// the mask of a set of component types
+			// mask - set to the mask
+			// returns EXIT_FAILURE if a type has no id
+			template <class... Ts>
+			static funcRet componentMask(uint64_t& mask)
+			{
+				mask = 0;
+				bool ret = true;
+				int expand[] = { 0, (ret = maskId(mask, componentId<Ts>()) && ret, 0)... };
+				(void)expand;
+
+				return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+			}
+
+			static const Entity* entities(Chunk* chunk) { return (const Entity*)((byte*)chunk + lineSize); } // the entity column of a chunk
+
+			template <class T>
+			static T* column(Chunk* chunk) { return (T*)((byte*)chunk + chunk->archetype->offsets[componentId<T>()]); } // a component column of a chunk
+
+			// run a parallelEach on a range of its chunks
+			template <class F, class... Ts>
+			static void runChunks(size_t begin, size_t end, void* data)
+			{
+				ChunkQuery<F>* query = (ChunkQuery<F>*)data;
+
+				for (size_t i = begin; i < end; ++i)
+				{
+					Chunk* chunk = query->chunks[i];
+					(*query->function)((size_t)chunk->count, entities(chunk), column<Ts>(chunk)...);
+				}
+			}
+
+			// find the archetype of a component set, making it if it is new
+			// mask - the component set
+			Archetype* findArchetype(uint64_t mask);
+
+			// take the next row of an archetype, adding a chunk if the last is full
+			// archetype - the archetype to grow
+			// chunk - set to the chunk of the row
+			// row - set to the row
+			funcRet allocateRow(Archetype* archetype, Chunk*& chunk, uint32_t& row);
+
+			// free a row, moving the archetype's last entity into it to stay packed
+			// chunk - the chunk of the row
+			// row - the row to free
+			void freeRow(Chunk* chunk, uint32_t row);
+
+			void* addComponent(Entity entity, byte id); // add a component by id, returns it
+			funcRet removeComponent(Entity entity, byte id); // remove a component by id
+			void* getComponent(Entity entity, byte id); // get a component by id, nullptr if the entity does not have one
+
+			// move an entity to another archetype, copying the components both have
+			// record - the entity's record
+			// to - the archetype to move to
+			funcRet moveEntity(Record& record, Archetype* to);
+		};
+	}
+}
+
+#endif
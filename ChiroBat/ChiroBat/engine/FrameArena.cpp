@@ -0,0 +1,91 @@
+#include "FrameArena.h"
+#include "Memory.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Memory
+	{
+		funcRet FrameArena::init(size_t size, byte frames)
+		{
+			// prevent over-initialization
+			RET_ON_ERR(this->frames, EXIT_FAILURE, "[Frame Arena] re-initialization of the arenas was attempted");
+			RET_ON_ERR(frames < 1 || frames > maxFrames, EXIT_FAILURE, "[Frame Arena] %d frames requested, between 1 and %d are supported", frames, maxFrames);
+
+			// keep every arena a multiple of the alignment so the bump never straddles the end
+			this->size = (size + alignment - 1) & ~(alignment - 1);
+
+			byte allocated = 0;
+			while (allocated < frames && (arenas[allocated] = (byte*)MEMORY.alignMalloc(this->size, alignment, Tag::Frame)))
+				++allocated;
+
+			// give back the arenas already allocated
+			if (allocated < frames)
+				for (byte i = 0; i < allocated; ++i)
+					MEMORY.free(arenas[i], Tag::Frame);
+
+			RET_ON_ERR(allocated < frames, EXIT_FAILURE, "[Frame Arena] failed to allocate an arena of size %zu", this->size);
+
+			this->frames = frames;
+			current = 0;
+			top = 0;
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet FrameArena::shutDown()
+		{
+			// there is nothing to shut down if this is true
+			RET_ON_ERR(!frames, EXIT_FAILURE, "[Frame Arena] shutdown of the non-initialized arenas was attempted");
+
+			for (byte i = 0; i < frames; ++i)
+				MEMORY.free(arenas[i], Tag::Frame);
+
+			frames = 0;
+
+			return EXIT_SUCCESS;
+		}
+
+		void* FrameArena::malloc(size_t size)
+		{
+			// round up so the next bump stays aligned
+			size = (size + alignment - 1) & ~(alignment - 1);
+
+			size_t offset = top.fetch_add(size, std::memory_order_relaxed);
+
+			// the arena is spent for this frame
+			RET_ON_ERR(offset + size > this->size, nullptr, "[Frame Arena] frame allocation of %zu exceeds the %zu bytes left", size, this->size - (offset < this->size ? offset : this->size));
+
+			return arenas[current] + offset;
+		}
+
+		void* FrameArena::alignMalloc(size_t size, size_t align)
+		{
+			// the alignment must be a power of 2
+			RET_ON_ERR(!align || align & (align - 1), nullptr, "[Frame Arena] aligned malloc alignment of %zu is not a power of 2", align);
+
+			if (align <= alignment) // every bump is already this aligned
+				return malloc(size);
+
+			// reserve the worst case gap along with the request, then align inside it
+			byte* ret = (byte*)malloc(size + align - alignment);
+			if (!ret)
+				return nullptr;
+
+			return (void*)(((uintptr_t)ret + align - 1) & ~(uintptr_t)(align - 1));
+		}
+
+		void FrameArena::nextFrame()
+		{
+			// the arena coming around was last used frames ago, nothing in it is alive
+			current = (current + 1) % frames;
+			top.store(0, std::memory_order_relaxed);
+		}
+
+		size_t FrameArena::used()
+		{
+			size_t offset = top.load(std::memory_order_relaxed);
+			return offset < size ? offset : size;
+		}
+	}
+}
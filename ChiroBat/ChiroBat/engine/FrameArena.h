@@ -0,0 +1,48 @@
+#ifndef CHIROBAT_FRAMEARENA
+#define CHIROBAT_FRAMEARENA
+
+#include <atomic>
+#include "Types.h"
+#include "Patterns.h"
+
+#define FRAME_MEMORY ChiroBat::Memory::FrameArena::instance()
+
+// linear allocators for memory that only lives for a frame or two
+// allocation is a pointer bump, rotating to the next frame is the only free
+
+namespace ChiroBat
+{
+	namespace Memory
+	{
+		class FrameArena : public Patterns::Singleton<FrameArena>
+		{
+		public:
+			static constexpr byte maxFrames = 3; // triple buffering at most
+
+			// initialize the arenas, backed by the memory manager
+			// size - the bytes available to each frame
+			// frames - the number of frames in flight, 2 for double buffering, 3 for triple
+			funcRet init(size_t size, byte frames);
+			funcRet shutDown(); // release the arenas
+
+			void* malloc(size_t size); // allocate memory that lives until this arena comes around again
+			void* alignMalloc(size_t size, size_t align); // allocate aligned memory that lives until this arena comes around again
+
+			// move to the next arena, everything allocated in it the last time around is released
+			void nextFrame();
+
+			size_t used(); // the bytes handed out from the current arena
+
+		private:
+			static constexpr size_t alignment = 16; // every allocation is kept at least this aligned
+
+			byte* arenas[maxFrames]; // the backing memory of each frame
+			size_t size; // the bytes available to each frame
+			byte frames; // the number of arenas in rotation
+			byte current; // the arena allocations come from
+			std::atomic<size_t> top; // the bump offset into the current arena, shared by every thread
+		};
+	}
+}
+
+#endif
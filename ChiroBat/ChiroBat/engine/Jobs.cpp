@@ -0,0 +1,381 @@
+#include <new>
+#include <thread>
+#include "Jobs.h"
+#include "Memory.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Jobs
+	{
+		// a queued job, allocated from the memory manager and released once it runs
+		struct JobSystem::Job
+		{
+			JobFunction function; // the job, nullptr for a range
+			RangeFunction rangeFunction; // the range, nullptr for a plain job
+			void* data; // passed to the function
+			size_t begin; // the first item of the range
+			size_t end; // one past the last item of the range
+			Counter* counter; // counted down once the job is done, may be nullptr
+			Job* next; // the next job in the shared queue
+		};
+
+		// a worker thread and its Chase-Lev deque
+		// only the owner touches the bottom, thieves race each other and the owner's last job on the top
+		struct JobSystem::Worker
+		{
+			alignas(64) std::atomic<ptrdiff_t> top; // the oldest job, where thieves take from
+			alignas(64) std::atomic<ptrdiff_t> bottom; // one past the newest job, where the owner pushes and pops
+			std::atomic<Job*> slots[dequeSize]; // the ring the deque lives in
+			std::thread thread; // the worker's thread, empty for worker 0
+			uint32_t seed; // picks the first worker to steal from
+
+			bool push(Job* job); // add a job at the bottom, false if the deque is full
+			Job* pop(); // take the newest job, nullptr if none
+			Job* steal(); // take the oldest job from another thread, nullptr if none or another thread won it
+		};
+
+		bool JobSystem::Worker::push(Job* job)
+		{
+			ptrdiff_t b = bottom.load(std::memory_order_relaxed);
+			ptrdiff_t t = top.load(std::memory_order_acquire);
+
+			if (b - t >= (ptrdiff_t)dequeSize)
+				return false;
+
+			slots[b & (dequeSize - 1)].store(job, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_release); // publish the job to thieves
+
+			return true;
+		}
+
+		JobSystem::Job* JobSystem::Worker::pop()
+		{
+			// claim the bottom job before looking at the top, thieves must see the claim
+			ptrdiff_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			ptrdiff_t t = top.load(std::memory_order_relaxed);
+
+			// empty, put the bottom back
+			if (t > b)
+			{
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			Job* ret = slots[b & (dequeSize - 1)].load(std::memory_order_relaxed);
+
+			// the last job, thieves may be after it too
+			if (t == b)
+			{
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					ret = nullptr;
+
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+
+			return ret;
+		}
+
+		JobSystem::Job* JobSystem::Worker::steal()
+		{
+			ptrdiff_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			ptrdiff_t b = bottom.load(std::memory_order_acquire);
+
+			if (t >= b)
+				return nullptr;
+
+			Job* ret = slots[t & (dequeSize - 1)].load(std::memory_order_relaxed);
+
+			// another thief or the owner got it first
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return nullptr;
+
+			return ret;
+		}
+
+		thread_local size_t JobSystem::workerIndex = JobSystem::noWorker;
+
+		JobSystem::JobSystem() : workerList(nullptr), workerCount(0), queued(0), sleeping(0), stopping(false), sharedHead(nullptr), sharedTail(nullptr), sharedCount(0)
+		{
+		}
+
+		funcRet JobSystem::init(size_t workers)
+		{
+			// prevent over-initialization
+			RET_ON_ERR(workerList, EXIT_FAILURE, "[Job System] re-initialization of the job system was attempted");
+
+			// one worker per core, this thread is one of them
+			if (!workers)
+				workers = std::thread::hardware_concurrency();
+			if (!workers)
+				workers = 1;
+
+			workerList = (Worker*)MEMORY.alignMalloc(sizeof(Worker) * workers, alignof(Worker), Memory::Tag::Jobs);
+			RET_ON_ERR(!workerList, EXIT_FAILURE, "[Job System] failed to allocate %zu workers", workers);
+
+			for (size_t i = 0; i < workers; ++i)
+			{
+				Worker* worker = new (workerList + i) Worker();
+				worker->top.store(0, std::memory_order_relaxed);
+				worker->bottom.store(0, std::memory_order_relaxed);
+				worker->seed = (uint32_t)i * 2654435761u + 1; // distinct and never 0, xorshift would stick at 0
+			}
+
+			workerCount = workers;
+			queued = 0;
+			stopping = false;
+			workerIndex = 0;
+
+			for (size_t i = 1; i < workers; ++i)
+				workerList[i].thread = std::thread(&JobSystem::work, this, i);
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet JobSystem::shutDown()
+		{
+			// there is nothing to shut down if this is true
+			RET_ON_ERR(!workerList, EXIT_FAILURE, "[Job System] shutdown of the non-initialized job system was attempted");
+
+			// set under the lock so no worker misses it between checking and sleeping
+			{
+				std::lock_guard<std::mutex> lock(sleepLock);
+				stopping = true;
+			}
+			wake.notify_all();
+
+			for (size_t i = 1; i < workerCount; ++i)
+				workerList[i].thread.join();
+
+			// the workers are gone, finish what they left behind
+			while (Job* job = findJob(0))
+				execute(job);
+
+			for (size_t i = 0; i < workerCount; ++i)
+				workerList[i].~Worker();
+
+			MEMORY.free(workerList, Memory::Tag::Jobs);
+
+			workerList = nullptr;
+			workerCount = 0;
+			workerIndex = noWorker;
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet JobSystem::run(JobFunction function, void* data, Counter* counter)
+		{
+			RET_ON_ERR(!workerList, EXIT_FAILURE, "[Job System] a job was run before the job system was initialized");
+
+			Job* job = newJob(counter);
+			RET_ON_ERR(!job, EXIT_FAILURE, "[Job System] failed to allocate a job");
+
+			job->function = function;
+			job->data = data;
+
+			submit(job);
+
+			return EXIT_SUCCESS;
+		}
+
+		void JobSystem::wait(Counter* counter)
+		{
+			// help out rather than block, what is being waited on may be sitting in this thread's own deque
+			while (!counter->done())
+			{
+				Job* job = workerList ? findJob(workerIndex) : nullptr;
+
+				if (job)
+					execute(job);
+				else
+					std::this_thread::yield();
+			}
+		}
+
+		funcRet JobSystem::parallelFor(size_t count, size_t grain, RangeFunction function, void* data)
+		{
+			RET_ON_ERR(!workerList, EXIT_FAILURE, "[Job System] a parallel for was run before the job system was initialized");
+
+			if (!count)
+				return EXIT_SUCCESS;
+
+			// a few ranges per worker evens out uneven ranges without drowning in jobs
+			if (!grain)
+				grain = count / (workerCount * 4);
+			if (!grain)
+				grain = 1;
+
+			Counter counter;
+
+			// the first range stays on this thread, it would only be waiting otherwise
+			size_t first = grain < count ? grain : count;
+
+			for (size_t begin = first; begin < count; begin += grain)
+			{
+				size_t end = count - begin > grain ? begin + grain : count;
+
+				Job* job = newJob(&counter);
+
+				// out of memory for jobs, the range still has to run
+				if (!job)
+				{
+					function(begin, end, data);
+					continue;
+				}
+
+				job->rangeFunction = function;
+				job->data = data;
+				job->begin = begin;
+				job->end = end;
+
+				submit(job);
+			}
+
+			function(0, first, data);
+			wait(&counter);
+
+			return EXIT_SUCCESS;
+		}
+
+		size_t JobSystem::workers()
+		{
+			return workerCount;
+		}
+
+		JobSystem::Job* JobSystem::newJob(Counter* counter)
+		{
+			Job* ret = (Job*)MEMORY.malloc(sizeof(Job), Memory::Tag::Jobs);
+			if (!ret)
+				return nullptr;
+
+			ret->function = nullptr;
+			ret->rangeFunction = nullptr;
+			ret->counter = counter;
+
+			if (counter)
+				counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+			return ret;
+		}
+
+		void JobSystem::submit(Job* job)
+		{
+			// counted before it is visible so a thief never takes the count below 0
+			queued.fetch_add(1);
+
+			// workers keep their jobs close, everyone else and full deques go through the shared queue
+			if (workerIndex >= workerCount || !workerList[workerIndex].push(job))
+			{
+				std::lock_guard<std::mutex> lock(sharedLock);
+
+				job->next = nullptr;
+				if (sharedTail)
+					sharedTail->next = job;
+				else
+					sharedHead = job;
+				sharedTail = job;
+
+				sharedCount.fetch_add(1, std::memory_order_release);
+			}
+
+			// a sleeper between checking for jobs and sleeping holds the lock, taking it makes sure the notify is not lost
+			if (sleeping.load())
+			{
+				{
+					std::lock_guard<std::mutex> lock(sleepLock);
+				}
+				wake.notify_one();
+			}
+		}
+
+		JobSystem::Job* JobSystem::findJob(size_t index)
+		{
+			Job* ret = nullptr;
+
+			// newest first from this worker's own deque, it is the warmest in cache
+			if (index < workerCount)
+				ret = workerList[index].pop();
+
+			if (!ret && sharedCount.load(std::memory_order_acquire))
+			{
+				std::lock_guard<std::mutex> lock(sharedLock);
+
+				ret = sharedHead;
+				if (ret)
+				{
+					sharedHead = ret->next;
+					if (!sharedHead)
+						sharedTail = nullptr;
+
+					sharedCount.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+
+			// oldest first from the others, starting somewhere random so thieves spread out
+			if (!ret && workerCount > 1)
+			{
+				size_t start = 0;
+				if (index < workerCount)
+				{
+					uint32_t& seed = workerList[index].seed;
+					seed ^= seed << 13;
+					seed ^= seed >> 17;
+					seed ^= seed << 5;
+					start = seed % workerCount;
+				}
+
+				for (size_t i = 0; i < workerCount && !ret; ++i)
+				{
+					size_t victim = (start + i) % workerCount;
+					if (victim != index)
+						ret = workerList[victim].steal();
+				}
+			}
+
+			if (ret)
+				queued.fetch_sub(1);
+
+			return ret;
+		}
+
+		void JobSystem::execute(Job* job)
+		{
+			if (job->rangeFunction)
+				job->rangeFunction(job->begin, job->end, job->data);
+			else
+				job->function(job->data);
+
+			// the waiter may return the moment the counter reaches 0, release the job first
+			Counter* counter = job->counter;
+			MEMORY.free(job, Memory::Tag::Jobs);
+
+			if (counter)
+				counter->pending.fetch_sub(1, std::memory_order_release);
+		}
+
+		void JobSystem::work(size_t index)
+		{
+			workerIndex = index;
+
+			while (!stopping.load(std::memory_order_acquire))
+			{
+				Job* job = findJob(index);
+
+				if (job)
+				{
+					execute(job);
+					continue;
+				}
+
+				// nothing to take, sleep until a job is queued
+				std::unique_lock<std::mutex> lock(sleepLock);
+				sleeping.fetch_add(1);
+				wake.wait(lock, [this] { return queued.load() || stopping.load(); });
+				sleeping.fetch_sub(1);
+			}
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef CHIROBAT_JOBS
+#define CHIROBAT_JOBS
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "Types.h"
+#include "Patterns.h"
+
+#define JOBS ChiroBat::Jobs::JobSystem::instance()
+
+// a work-stealing job system, one worker per core
+// every worker owns a deque, it pushes and pops the bottom while idle workers steal from the top
+// the thread that initializes the system is worker 0, it runs jobs whenever it waits on a counter
+// other threads may submit and wait too, their jobs go through a shared queue
+
+namespace ChiroBat
+{
+	namespace Jobs
+	{
+		typedef void(*JobFunction)(void* data); // a job, data is whatever was given with it
+		typedef void(*RangeFunction)(size_t begin, size_t end, void* data); // a slice [begin, end) of a parallel for
+
+		// counts the jobs left in a group, wait on it to know they are done
+		class Counter
+		{
+		public:
+			Counter() : pending(0) {}
+			Counter(const Counter&) = delete;
+			Counter& operator=(const Counter&) = delete;
+
+			bool done() const { return !pending.load(std::memory_order_acquire); } // true once every job given this counter has run
+
+		private:
+			friend class JobSystem;
+
+			std::atomic<size_t> pending; // the jobs given this counter that have not finished
+		};
+
+		class JobSystem : public Patterns::Singleton<JobSystem>
+		{
+		public:
+			JobSystem();
+
+			// start the workers, jobs and deques come from the memory manager which must be initialized with thread caches
+			// workers - the number of workers counting the initializing thread, 0 for one per core
+			funcRet init(size_t workers = 0);
+			funcRet shutDown(); // stop the workers, jobs still queued are run on the calling thread first
+
+			// queue a job
+			// function - the job to run
+			// data - passed to the job, it must stay valid until the job runs
+			// counter - counted up now and down once the job is done, may be nullptr
+			funcRet run(JobFunction function, void* data, Counter* counter = nullptr);
+
+			// run queued jobs on this thread until every job given the counter is done
+			// counter - the counter to wait on
+			void wait(Counter* counter);
+
+			// split [0, count) into ranges and run them across the workers, returns once every range is done
+			// count - the number of items
+			// grain - the items in each range, 0 to pick a few ranges per worker
+			// function - run on each range
+			// data - passed to every range
+			funcRet parallelFor(size_t count, size_t grain, RangeFunction function, void* data);
+
+			size_t workers(); // the number of workers counting the initializing thread, 0 if not initialized
+
+		private:
+			static constexpr size_t dequeSize = 1024; // the jobs a worker's deque holds, a power of 2, the shared queue takes the rest
+			static constexpr size_t noWorker = ~(size_t)0; // the worker index of threads outside the system
+
+			struct Job;
+			struct Worker;
+
+			Worker* workerList; // every worker, 0 is the initializing thread
+			size_t workerCount; // the length of workerList
+			std::atomic<size_t> queued; // jobs sitting in a deque or the shared queue
+			std::atomic<size_t> sleeping; // workers waiting for a job to be queued
+			std::atomic<bool> stopping; // set on shut down to release the workers
+
+			std::mutex sleepLock; // guards the wake up of sleeping workers
+			std::condition_variable wake; // signalled when a job is queued
+
+			std::mutex sharedLock; // guards the shared queue
+			Job* sharedHead; // the oldest job in the shared queue
+			Job* sharedTail; // the newest job in the shared queue
+			std::atomic<size_t> sharedCount; // the length of the shared queue, checked before taking the lock
+
+			static thread_local size_t workerIndex; // this thread's worker, noWorker outside the system
+
+			// allocate a job and count it against a counter
+			// counter - the counter to count it against, may be nullptr
+			Job* newJob(Counter* counter);
+			void submit(Job* job); // queue a job and wake a worker for it
+			Job* findJob(size_t index); // take a job from a worker's own deque, the shared queue, or another worker, nullptr if none
+			static void execute(Job* job); // run a job, release it, and count down its counter
+			void work(size_t index); // the loop of a worker thread
+		};
+	}
+}
+
+#endif
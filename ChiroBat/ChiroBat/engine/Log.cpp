@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include "Log.h"
+
+namespace ChiroBat
+{
+	namespace Log
+	{
+		static constexpr size_t ringSlots = 4096; // the records in flight, a power of 2, more are dropped and counted
+		static constexpr size_t batchSize = 1 << 16; // the bytes formatted before each write
+
+		// a record in the ring, the sequence says whose turn the slot is
+		// pos - free for the producer claiming position pos
+		// pos + 1 - filled, ready for the consumer at position pos
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			Record record;
+		};
+
+		// Vyukov's bounded queue, producers race on the tail, the background thread alone owns the head
+		static Slot slots[ringSlots];
+		static std::atomic<size_t> tail(0); // the next position a producer claims
+		static size_t head = 0; // the next position the background thread reads
+
+		static std::atomic<bool> running(false); // true while the background thread takes records
+		static std::atomic<bool> stopping(false); // set to end the background thread
+		static std::atomic<size_t> dropped(0); // records lost to a full ring
+		static std::atomic<size_t> producers(0); // submits that may still queue a record, the background thread stops only once none are left
+		static std::atomic<Severity> level(Severity::Debug); // records below this are dropped
+		static std::thread writer; // the background thread
+
+		static const char* const severityNames[] = { "[debug] ", "[info] ", "[warning] ", "[error] " };
+
+		// read the next packed argument
+		// record - the record to read from
+		// at - the offset of the argument, moved past it
+		// type - set to the argument's type
+		// value - set to the argument's value, for a string its length
+		// string - set to a string's characters
+		static bool nextArg(const Record& record, size_t& at, ArgType& type, uint64_t& value, const char*& string)
+		{
+			if (at >= record.size)
+				return false;
+
+			type = (ArgType)record.args[at++];
+
+			if (type == ArgType::String)
+			{
+				uint16_t length;
+				memcpy(&length, record.args + at, sizeof(length));
+				string = (const char*)record.args + at + sizeof(length);
+				value = length;
+				at += sizeof(length) + length;
+			}
+			else
+			{
+				memcpy(&value, record.args + at, sizeof(value));
+				at += sizeof(value);
+			}
+
+			return true;
+		}
+
+		// format a record as a line of text
+		// record - the record to format
+		// out - where to write the line
+		// capacity - the bytes out can hold, at least 2
+		// returns the bytes written, the line always ends in a newline
+		static size_t formatRecord(const Record& record, char* out, size_t capacity)
+		{
+			size_t length = 0;
+			size_t at = 0;
+
+			// append a formatted piece, cutting it at the end of the line
+			auto append = [&](int written)
+			{
+				if (written > 0)
+					length += (size_t)written < capacity - 1 - length ? (size_t)written : capacity - 2 - length;
+			};
+
+			append(snprintf(out, capacity - 1, "%s", severityNames[(size_t)record.severity]));
+
+			for (const char* c = record.format; *c && length < capacity - 2; ++c)
+			{
+				if (*c != '%')
+				{
+					out[length++] = *c;
+					continue;
+				}
+
+				if (c[1] == '%')
+				{
+					out[length++] = '%';
+					++c;
+					continue;
+				}
+
+				// copy the flags, width, and precision, the length modifier is replaced by the stored type's
+				char spec[32] = "%";
+				size_t specLength = 1;
+				for (++c; *c && strchr("-+ #0123456789.", *c) && specLength < sizeof(spec) - 4; ++c)
+					spec[specLength++] = *c;
+				while (*c && strchr("hljztL", *c))
+					++c;
+				if (!*c)
+					break;
+
+				char conversion = *c;
+
+				ArgType type;
+				uint64_t value;
+				const char* string = nullptr;
+				if (!nextArg(record, at, type, value, string))
+				{
+					append(snprintf(out + length, capacity - 1 - length, "<missing>"));
+					continue;
+				}
+
+				switch (type)
+				{
+				case ArgType::Signed:
+				case ArgType::Unsigned:
+					if (conversion == 'c')
+					{
+						spec[specLength++] = 'c';
+						spec[specLength] = 0;
+						append(snprintf(out + length, capacity - 1 - length, spec, (int)value));
+						break;
+					}
+
+					// anything not an integer conversion prints as one
+					if (!strchr("diouxX", conversion))
+						conversion = type == ArgType::Signed ? 'd' : 'u';
+
+					spec[specLength++] = 'l';
+					spec[specLength++] = 'l';
+					spec[specLength++] = conversion;
+					spec[specLength] = 0;
+					if (type == ArgType::Signed)
+						append(snprintf(out + length, capacity - 1 - length, spec, (long long)(int64_t)value));
+					else
+						append(snprintf(out + length, capacity - 1 - length, spec, (unsigned long long)value));
+					break;
+				case ArgType::Double:
+				{
+					double number;
+					memcpy(&number, &value, sizeof(number));
+
+					if (!strchr("fFeEgGaA", conversion))
+						conversion = 'g';
+
+					spec[specLength++] = conversion;
+					spec[specLength] = 0;
+					append(snprintf(out + length, capacity - 1 - length, spec, number));
+					break;
+				}
+				case ArgType::Pointer:
+					append(snprintf(out + length, capacity - 1 - length, "%p", (void*)(uintptr_t)value));
+					break;
+				case ArgType::String:
+				{
+					// a precision given in the format still limits the string
+					char* precision = strchr(spec, '.');
+					if (precision)
+					{
+						unsigned long limit = strtoul(precision + 1, nullptr, 10);
+						if (limit < value)
+							value = limit;
+						specLength = precision - spec;
+					}
+
+					spec[specLength++] = '.';
+					spec[specLength++] = '*';
+					spec[specLength++] = 's';
+					spec[specLength] = 0;
+					append(snprintf(out + length, capacity - 1 - length, spec, (int)value, string));
+					break;
+				}
+				}
+			}
+
+			if (record.suppressed)
+				append(snprintf(out + length, capacity - 1 - length, " (%u more from here suppressed)", record.suppressed));
+
+			out[length++] = '\n';
+
+			return length;
+		}
+
+		// the background thread, it formats records into a batch and writes the batch at once
+		static void writeRecords()
+		{
+			static char batch[batchSize];
+
+			for (;;)
+			{
+				// a producer that saw the logger running publishes its record before it leaves, so nothing is queued after the last drain
+				bool stop = stopping.load(std::memory_order_acquire) && !producers.load();
+				size_t used = 0;
+
+				// take records until the batch could not hold another line
+				while (batchSize - used > recordSize * 4)
+				{
+					Slot& slot = slots[head & (ringSlots - 1)];
+					if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+						break;
+
+					used += formatRecord(slot.record, batch + used, batchSize - used);
+
+					// hand the slot to the producer one lap ahead
+					slot.sequence.store(head + ringSlots, std::memory_order_release);
+					++head;
+				}
+
+				size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+				if (lost)
+					used += snprintf(batch + used, batchSize - used, "[warning] [Log] %zu records were dropped, the ring was full\n", lost);
+
+				if (used)
+				{
+					fwrite(batch, 1, used, stderr);
+					fflush(stderr);
+					continue;
+				}
+
+				// stop only once the ring is drained and no producer is left
+				if (stop)
+					return;
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		funcRet start()
+		{
+			if (running.load())
+				return EXIT_FAILURE;
+
+			// the ring keeps its positions across restarts, only the first start lays out the slots
+			static bool ready = false;
+			if (!ready)
+			{
+				for (size_t i = 0; i < ringSlots; ++i)
+					slots[i].sequence.store(i, std::memory_order_relaxed);
+				ready = true;
+			}
+
+			stopping = false;
+			writer = std::thread(writeRecords);
+			running = true;
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet stop()
+		{
+			if (!running.load())
+				return EXIT_FAILURE;
+
+			// later records are written synchronously, the thread drains what was queued and what producers already past the check still queue
+			running = false;
+			stopping = true;
+			writer.join();
+
+			return EXIT_SUCCESS;
+		}
+
+		void setLevel(Severity level)
+		{
+			Log::level.store(level, std::memory_order_relaxed);
+		}
+
+		bool admit(Severity severity, Site& site, uint32_t& suppressed)
+		{
+			if (severity < level.load(std::memory_order_relaxed))
+				return false;
+
+			int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+			// one thread wins the move to a new window and restarts the count
+			int64_t window = site.window.load(std::memory_order_relaxed);
+			if (now - window >= siteWindow && site.window.compare_exchange_strong(window, now, std::memory_order_relaxed))
+				site.count.store(0, std::memory_order_relaxed);
+
+			if (site.count.fetch_add(1, std::memory_order_relaxed) >= siteLimit)
+			{
+				site.suppressed.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+			return true;
+		}
+
+		void submit(const Record& record)
+		{
+			// counted before the running check, stop sees every producer that goes on to use the ring
+			producers.fetch_add(1);
+
+			if (!running.load())
+			{
+				producers.fetch_sub(1, std::memory_order_relaxed);
+
+				char line[recordSize * 4];
+				size_t length = formatRecord(record, line, sizeof(line));
+				fwrite(line, 1, length, stderr);
+				return;
+			}
+
+			// claim a slot, a slot still a lap behind means the ring is full
+			size_t position = tail.load(std::memory_order_relaxed);
+			Slot* slot;
+			for (;;)
+			{
+				slot = &slots[position & (ringSlots - 1)];
+				size_t sequence = slot->sequence.load(std::memory_order_acquire);
+				ptrdiff_t lag = (ptrdiff_t)(sequence - position);
+
+				if (!lag && tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+
+				if (lag < 0)
+				{
+					dropped.fetch_add(1, std::memory_order_relaxed);
+					producers.fetch_sub(1, std::memory_order_release);
+					return;
+				}
+
+				if (lag > 0)
+					position = tail.load(std::memory_order_relaxed);
+			}
+
+			// copy only the packed part of the record
+			memcpy(&slot->record, &record, offsetof(Record, args) + record.size);
+			slot->sequence.store(position + 1, std::memory_order_release);
+			producers.fetch_sub(1, std::memory_order_release);
+		}
+	}
+}
@@ -0,0 +1,154 @@
+#ifndef CHIROBAT_LOG
+#define CHIROBAT_LOG
+
+#include <atomic>
+#include <string.h>
+#include "Types.h"
+
+// an asynchronous logger, see the LOG_ macros in Debug.h
+// a call packs its format pointer and arguments into a record on a lock-free ring and returns
+// a background thread formats the records and writes them to stderr in batches
+// strings are copied into the record, everything else is stored by value, the format must be a literal
+// each call site logs at most siteLimit times per siteWindow, the rest are counted and reported with its next record
+// while the logger is not running, records are written synchronously instead
+
+namespace ChiroBat
+{
+	namespace Log
+	{
+		enum class Severity : byte // how much a record matters, records below the level are dropped
+		{
+			Debug, // tracing
+			Info, // notable events
+			Warning, // something went wrong and was recovered from
+			Error // something failed
+		};
+
+		static constexpr uint32_t siteLimit = 10; // the records a call site may log per window
+		static constexpr int64_t siteWindow = 1000; // the length of a rate limit window in milliseconds
+
+		struct Site // the rate limit of a call site, static at the call site so it starts zeroed
+		{
+			std::atomic<int64_t> window; // the millisecond the current window started at
+			std::atomic<uint32_t> count; // the records logged in the current window
+			std::atomic<uint32_t> suppressed; // the records dropped since the last one logged
+		};
+
+		enum class ArgType : byte // how an argument is stored in a record
+		{
+			Signed, // an int64_t
+			Unsigned, // a uint64_t
+			Double, // a double
+			Pointer, // a const void*
+			String // a uint16_t length followed by the characters
+		};
+
+		static constexpr size_t recordSize = 256; // the bytes of a record, longer strings are cut short
+
+		struct Record // a log call, ready to format
+		{
+			const char* format; // the format string
+			uint32_t suppressed; // the records its call site dropped before it
+			uint16_t size; // the bytes of args in use
+			Severity severity; // how much the record matters
+			byte args[recordSize - sizeof(const char*) - sizeof(uint32_t) - sizeof(uint16_t) - sizeof(Severity)]; // the packed arguments
+		};
+
+		// packs a call's arguments into a record
+		struct Packer
+		{
+			Record& record; // the record being packed
+
+			void put(ArgType type, const void* value, size_t size)
+			{
+				// an argument that does not fit is dropped, the formatter prints what it has
+				if (record.size + 1 + size > sizeof(record.args))
+					return;
+
+				record.args[record.size] = (byte)type;
+				memcpy(record.args + record.size + 1, value, size);
+				record.size += (uint16_t)(1 + size);
+			}
+
+			void pack(char value) { int64_t v = value; put(ArgType::Signed, &v, sizeof(v)); }
+			void pack(signed char value) { int64_t v = value; put(ArgType::Signed, &v, sizeof(v)); }
+			void pack(short value) { int64_t v = value; put(ArgType::Signed, &v, sizeof(v)); }
+			void pack(int value) { int64_t v = value; put(ArgType::Signed, &v, sizeof(v)); }
+			void pack(long value) { int64_t v = value; put(ArgType::Signed, &v, sizeof(v)); }
+			void pack(long long value) { int64_t v = value; put(ArgType::Signed, &v, sizeof(v)); }
+			void pack(unsigned char value) { uint64_t v = value; put(ArgType::Unsigned, &v, sizeof(v)); }
+			void pack(unsigned short value) { uint64_t v = value; put(ArgType::Unsigned, &v, sizeof(v)); }
+			void pack(unsigned int value) { uint64_t v = value; put(ArgType::Unsigned, &v, sizeof(v)); }
+			void pack(unsigned long value) { uint64_t v = value; put(ArgType::Unsigned, &v, sizeof(v)); }
+			void pack(unsigned long long value) { uint64_t v = value; put(ArgType::Unsigned, &v, sizeof(v)); }
+			void pack(bool value) { uint64_t v = value; put(ArgType::Unsigned, &v, sizeof(v)); }
+			void pack(float value) { double v = value; put(ArgType::Double, &v, sizeof(v)); }
+			void pack(double value) { put(ArgType::Double, &value, sizeof(value)); }
+			void pack(char* value) { pack((const char*)value); }
+
+			void pack(const char* value)
+			{
+				if (!value)
+					value = "(null)";
+
+				// cut the string to what is left, keeping room for its type and length
+				size_t room = sizeof(record.args) - record.size;
+				size_t length = strlen(value);
+				if (room < 1 + sizeof(uint16_t))
+					return;
+				if (length > room - 1 - sizeof(uint16_t))
+					length = room - 1 - sizeof(uint16_t);
+
+				uint16_t stored = (uint16_t)length;
+				record.args[record.size] = (byte)ArgType::String;
+				memcpy(record.args + record.size + 1, &stored, sizeof(stored));
+				memcpy(record.args + record.size + 1 + sizeof(stored), value, length);
+				record.size += (uint16_t)(1 + sizeof(stored) + length);
+			}
+
+			template <class T>
+			void pack(T* value) { const void* v = value; put(ArgType::Pointer, &v, sizeof(v)); }
+		};
+
+		funcRet start(); // start the background thread, records are written synchronously until then
+		funcRet stop(); // write every queued record and stop the background thread
+
+		void setLevel(Severity level); // drop records below a severity, Debug lets everything through
+
+		// check a call site's rate limit and the level
+		// severity - the record's severity
+		// site - the call site
+		// suppressed - set to the records the site dropped since it last logged
+		bool admit(Severity severity, Site& site, uint32_t& suppressed);
+
+		void submit(const Record& record); // queue a packed record, or write it if the logger is not running
+
+		// log a record, use the LOG_ macros rather than calling this
+		// severity - how much the record matters
+		// site - the call site's rate limit
+		// format - a printf format literal
+		// args - the format's arguments
+		template <class... Args>
+		void write(Severity severity, Site& site, const char* format, Args... args)
+		{
+			uint32_t suppressed;
+			if (!admit(severity, site, suppressed))
+				return;
+
+			Record record;
+			record.format = format;
+			record.suppressed = suppressed;
+			record.size = 0;
+			record.severity = severity;
+
+			Packer packer = { record };
+			int expand[] = { 0, (packer.pack(args), 0)... };
+			(void)expand;
+			(void)packer;
+
+			submit(record);
+		}
+	}
+}
+
+#endif
@@ -1,199 +1,2194 @@
-#include <malloc.h>
 #include <string.h>
+#include <algorithm>
+#if defined _M_X64 || defined __SSE2__
+#include <emmintrin.h>
+#endif
 #include "Memory.h"
 #include "Debug.h"
 
+// shorthand for the allocator's out of class definitions
+#define TLSF_TEMPLATE template <byte SLBits, size_t MinBlock, size_t MaxPool>
+#define TLSF_ALLOCATOR TLSFAllocator<SLBits, MinBlock, MaxPool>
+
 namespace ChiroBat
 {
 	namespace Memory
 	{
-		funcRet MemoryManager::init(size_t poolSize, bool expand)
+		static constexpr size_t streamSize = 1 << 20; // clears this large go around the caches, the data would only evict the working set
+
+		// zero memory, with non-temporal stores once it is large
+		// data - the memory to zero
+		// size - the bytes to zero
+		static void clearMemory(void* data, size_t size)
+		{
+#if defined _M_X64 || defined __SSE2__
+			if (size >= streamSize)
+			{
+				// the streaming stores need 16 byte alignment, the bytes up to it are cleared normally
+				byte* at = (byte*)data;
+				size_t head = (size_t)(0 - (uintptr_t)at) & 15;
+				memset(at, 0, head);
+				at += head;
+				size -= head;
+
+				__m128i zero = _mm_setzero_si128();
+				for (byte* end = at + (size & ~(size_t)63); at < end; at += 64)
+				{
+					_mm_stream_si128((__m128i*)at, zero);
+					_mm_stream_si128((__m128i*)(at + 16), zero);
+					_mm_stream_si128((__m128i*)(at + 32), zero);
+					_mm_stream_si128((__m128i*)(at + 48), zero);
+				}
+				_mm_sfence(); // order the streamed stores before the memory is handed out
+
+				memset(at, 0, size & 63);
+				return;
+			}
+#endif
+
+			memset(data, 0, size);
+		}
+
+		TLSF_TEMPLATE
+		thread_local typename TLSF_ALLOCATOR::CacheTable TLSF_ALLOCATOR::localCaches;
+
+		TLSF_TEMPLATE
+		std::atomic<size_t> TLSF_ALLOCATOR::epochs(0);
+
+		TLSF_TEMPLATE
+		TLSF_ALLOCATOR* TLSF_ALLOCATOR::heaps = nullptr;
+
+		TLSF_TEMPLATE
+		std::mutex TLSF_ALLOCATOR::registryLock;
+
+		TLSF_TEMPLATE
+		TLSF_ALLOCATOR::CacheTable::~CacheTable()
+		{
+			for (ThreadCache& cache : caches)
+				releaseCache(&cache);
+		}
+
+		TLSF_TEMPLATE
+		TLSF_ALLOCATOR::TLSFAllocator()
+			: maxRequestSize(0), poolSize(0), poolBlockSize(0), expand(0), pageType(Platform::PageType::Standard), retainPools(1), emptyPools(0), realTime(0),
+			pool(nullptr), flMask(0), threaded(0), epoch(0), prevHeap(nullptr), nextHeap(nullptr), slabPageSize(0),
+			handleCount(0), freeHandles(noSlot), compactPool(0), lapMoved(0)
+		{
+			for (std::atomic<HandleSlot*>& page : handleTable)
+				page = nullptr;
+		}
+
+		TLSF_TEMPLATE
+		TLSF_ALLOCATOR::~TLSFAllocator()
+		{
+			if (pool)
+				shutDown();
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::init(size_t poolSize, bool expand, bool threadCache, Platform::PageType pages)
 		{
 			// prevent over-initialization
 			RET_ON_ERR(pool, EXIT_FAILURE, "[Memory Manager] re-initialization of the manager was attempted");
 
-			// compute the system's needs, 32 | 64
-			SLgranularity = sizeof(void*) * 8; // 32 | 64
-			SLbitDepth = findMSB(SLgranularity); // 5 | 6
-			bitPack = findMSB(sizeof(void*)); // 2 | 3
-			packedFLI = SLbitDepth + bitPack - 1; // 6 | 8
-			bitPackMask = ~(size_t)0 << bitPack;
+			reset(poolSize, expand, threadCache, pages);
+
+			// map the first pool, on failure the manager stays uninitialized
+			RET_ON_ERR(addPool(), EXIT_FAILURE, "[Memory Manager] failed to map the first pool");
+
+			joinHeaps();
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::reset(size_t poolSize, bool expand, bool threadCache, Platform::PageType pages)
+		{
+			// clamp the pool to allow the block to fit, and to the tables sized at compile time
+			poolSize = poolSize < sizeof(Pool) ? sizeof(Pool) : poolSize;
+			poolSize = poolSize > MaxPool ? MaxPool : poolSize;
+
+			// determine the maximum first layer size (un-adjusted)
+			byte FLmax = findMSB(poolSize);
+
+			// find the largest block allowed in the free blocks array
+			maxRequestSize = (((size_t)1 << (FLmax + 1)) - 1) & bitPackMask;
+
+			// how big a pool needs to be to accomodate the header, block data, rewuested size, and fake block at the end
+			// rounded up to whole pages, the pool's block takes the slack
+			this->poolSize = Platform::mappingSize(offsetof(Pool, block.block.data) + maxRequestSize + sizeof(size_t), pages);
+			poolBlockSize = (this->poolSize - offsetof(Pool, block.block.data) - sizeof(size_t)) & bitPackMask;
+			poolBlockSize = poolBlockSize > maxBlockSize ? maxBlockSize : poolBlockSize;
+			pageType = pages;
+			retainPools = 1;
+			emptyPools = 0;
+			realTime = 0;
+
+			// slab pages are page aligned blocks, the pools must fit one after the worst case alignment gap
+			slabPageSize = 2 * Platform::pageSize() + minBlockSize + sizeof(size_t) <= maxRequestSize ? Platform::pageSize() : 0;
+			memset(slabPages, 0, sizeof(slabPages));
+
+			// the handle table is mapped on first use
+			handleCount = 0;
+			freeHandles = noSlot;
+			compactPool = 0;
+			lapMoved = 0;
+
+			// clear the free blocks array
+			memset(freeBlocks, 0, sizeof(freeBlocks));
+			memset(slMasks, 0, sizeof(slMasks));
+			flMask = 0;
+
+			// any thread caches left over from a previous run are now stale
+			threaded = threadCache;
+			epoch = ++epochs;
+
+#if defined CHIROBAT_MEMORY_STATS
+			// every counter starts over, the atomics cannot be memset
+			for (StatShard& shard : shards)
+			{
+				for (size_t i = 0; i < tagCount; ++i)
+				{
+					shard.tagLive[i] = 0;
+					shard.tagAllocations[i] = 0;
+					shard.tagFrees[i] = 0;
+				}
+
+				for (std::atomic<size_t>& count : shard.binAllocations)
+					count = 0;
+
+				shard.largeAllocations = 0;
+			}
+
+			poolBytes = 0;
+			freeBytes = 0;
+			peakBytes = 0;
+			largeBytes = 0;
+#endif
+
+			this->expand = expand;
+			pool = nullptr;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::joinHeaps()
+		{
+			// thread caches may drain into it from now on
+			std::lock_guard<std::mutex> registry(registryLock);
+			prevHeap = nullptr;
+			nextHeap = heaps;
+			if (heaps)
+				heaps->prevHeap = this;
+			heaps = this;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::shutDown()
+		{
+			// there is nothing to shut down if this is true
+			RET_ON_ERR(!pool, EXIT_FAILURE, "[Memory Manager] shutdown of the non-initialized manager was attempted");
+
+			// cached blocks live in the pools about to be freed, leave the live heaps so no cache drains into them
+			{
+				std::lock_guard<std::mutex> registry(registryLock);
+				if (prevHeap)
+					prevHeap->nextHeap = nextHeap;
+				else
+					heaps = nextHeap;
+				if (nextHeap)
+					nextHeap->prevHeap = prevHeap;
+
+				epoch = 0;
+			}
+
+			unmapPools();
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::unmapPools()
+		{
+			// run through the pool list
+			Pool* temp;
+			while (pool) // while there is a pool
+			{
+				temp = pool->prevPool; // track where you are
+				Platform::unmapMemory(pool, poolSize); // return this pool to the OS
+				pool = temp; // move to the tracker
+			}
+
+			// every handle went with the pools
+			for (std::atomic<HandleSlot*>& page : handleTable)
+			{
+				if (page)
+					Platform::unmapMemory(page, sizeof(HandleSlot) * handlePageSlots);
+				page = nullptr;
+			}
+		}
+
+		TLSF_TEMPLATE
+		bool TLSF_ALLOCATOR::initialized()
+		{
+			return pool != nullptr;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::setPoolRetention(size_t pools)
+		{
+			retainPools = pools;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::setRealTime(bool realTime)
+		{
+			this->realTime = realTime;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::getStats(Stats* stats)
+		{
+			// there is nothing to report if this is true
+			RET_ON_ERR(!pool, EXIT_FAILURE, "[Memory Manager] stats of the non-initialized manager were requested");
+
+			memset(stats, 0, sizeof(Stats));
+
+			// the pools and free blocks only hold still under the lock
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			for (Pool* temp = pool; temp; temp = temp->prevPool)
+				++stats->pools;
+
+			for (size_t bin = 0; bin < binCount; ++bin)
+			{
+				for (Block* block = freeBlocks[bin]; block; block = block->block.free.next)
+				{
+					stats->freeBytes += blockSize(block);
+					stats->largestFreeBlock = blockSize(block) > stats->largestFreeBlock ? blockSize(block) : stats->largestFreeBlock;
+				}
+			}
+
+			stats->mappedBytes = stats->pools * poolSize;
+			stats->usedBytes = stats->pools * poolBlockSize - stats->freeBytes;
+			stats->fragmentation = stats->freeBytes ? 1.0f - (float)stats->largestFreeBlock / stats->freeBytes : 0.0f;
+
+#if defined CHIROBAT_MEMORY_STATS
+			stats->peakBytes = peakBytes;
+			stats->mappedBytes += largeBytes;
+
+			// the counters are summed without stopping other threads, each is exact but they may be from slightly different moments
+			for (StatShard& shard : shards)
+			{
+				for (size_t i = 0; i < tagCount; ++i)
+				{
+					stats->tags[i].liveBytes += shard.tagLive[i].load(std::memory_order_relaxed);
+					stats->tags[i].allocations += shard.tagAllocations[i].load(std::memory_order_relaxed);
+					stats->tags[i].frees += shard.tagFrees[i].load(std::memory_order_relaxed);
+				}
+
+				for (size_t bin = 0; bin < binCount; ++bin)
+					stats->binAllocations[bin] += shard.binAllocations[bin].load(std::memory_order_relaxed);
+
+				stats->largeAllocations += shard.largeAllocations.load(std::memory_order_relaxed);
+			}
+
+			for (size_t i = 0; i < tagCount; ++i)
+				stats->liveBytes += stats->tags[i].liveBytes;
+#endif
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::binSize(size_t bin)
+		{
+			size_t fl = bin / SLgranularity, sl = bin % SLgranularity;
+
+			// the inverse of getIndex, the packed layer has a bin per aligned size
+			if (!fl)
+				return (sl + 1) << bitPack;
+
+			return (SLgranularity + sl) << (fl + packedFLI - SLbitDepth);
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::walkHeap(HeapVisitor visitor, void* user)
+		{
+			// there is nothing to walk if this is true
+			RET_ON_ERR(!pool, EXIT_FAILURE, "[Memory Manager] walk of the non-initialized manager was attempted");
+
+			// blocks only hold still under the lock
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			// walk from the oldest pool so indices stay put as pools are added
+			Pool* current = pool;
+			while (current->prevPool)
+				current = current->prevPool;
+
+			for (size_t index = 0; current; current = current->nextPool, ++index)
+			{
+				// the fake block capping the pool, every walk must land on it exactly
+				Block* cap = (Block*)(&current->block.block.data + poolBlockSize - offsetof(Block, size));
+				Block* block = &current->block;
+
+				while (block < cap)
+				{
+					SlabPage* page = (SlabPage*)&block->block.data;
+
+					BlockInfo info;
+					info.data = &block->block.data;
+					info.size = blockSize(block);
+					info.pool = index;
+					info.free = (block->size & 1) != 0;
+					info.slab = !info.free && slabPageSize && !((uintptr_t)page & (slabPageSize - 1)) && page->check == ((uintptr_t)page ^ slabKey);
+					info.handle = !info.free && !info.slab && isHandle(block);
+
+					if (!visitor(info, user))
+						return EXIT_SUCCESS;
+
+					block = (Block*)((byte*)block + blockSize(block) + offsetof(Block, size));
+				}
+
+				RET_ON_ERR(block != cap, EXIT_FAILURE, "[Memory Manager] the blocks of pool %zu run past its end", index);
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::analyzeHeap(HeapReport* report, PoolUsage* pools, size_t poolCount)
+		{
+			memset(report, 0, sizeof(HeapReport));
+			if (pools)
+				memset(pools, 0, sizeof(PoolUsage) * poolCount);
+
+			HeapAnalysis analysis = { report, pools, pools ? poolCount : 0, 0, false };
+			RET_ON_ERR(walkHeap(analyzeBlock, &analysis), EXIT_FAILURE, "[Memory Manager] the heap could not be analyzed");
+
+			report->fragmentation = report->freeBytes ? 1.0f - (float)report->largestFreeBlock / report->freeBytes : 0.0f;
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		bool TLSF_ALLOCATOR::analyzeBlock(const BlockInfo& block, void* user)
+		{
+			HeapAnalysis* analysis = (HeapAnalysis*)user;
+			HeapReport* report = analysis->report;
+
+			if (!report->blocks || block.pool != analysis->lastPool) // the first block of a pool
+			{
+				++report->pools;
+				analysis->lastFree = false;
+			}
+
+			PoolUsage* usage = block.pool < analysis->poolCount ? &analysis->pools[block.pool] : nullptr;
+
+			++report->blocks;
+			if (usage)
+				++usage->blocks;
+
+			if (block.free)
+			{
+				MapIndex index;
+				getIndex(block.size, &index);
+
+				++report->freeBlocks;
+				++report->binFreeBlocks[index.bin];
+				report->freeBytes += block.size;
+				report->largestFreeBlock = block.size > report->largestFreeBlock ? block.size : report->largestFreeBlock;
+				report->unmergedFreeBlocks += analysis->lastFree;
+
+				if (usage)
+				{
+					++usage->freeBlocks;
+					usage->freeBytes += block.size;
+					usage->largestFreeBlock = block.size > usage->largestFreeBlock ? block.size : usage->largestFreeBlock;
+				}
+			}
+			else
+			{
+				report->usedBytes += block.size + sizeof(size_t);
+				report->slabPages += block.slab;
+
+				if (usage)
+					usage->usedBytes += block.size + sizeof(size_t);
+			}
+
+			analysis->lastPool = block.pool;
+			analysis->lastFree = block.free;
+
+			return true;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::checkHeap()
+		{
+			// there is nothing to check if this is true
+			RET_ON_ERR(!pool, EXIT_FAILURE, "[Memory Manager] check of the non-initialized manager was attempted");
+
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			size_t freeCount = 0, emptyCount = 0;
+
+			// every pool must be a chain of blocks whose flags agree with their neighbors
+			for (Pool* current = pool; current; current = current->prevPool)
+			{
+				RET_ON_ERR(current->nextPool && current->nextPool->prevPool != current, EXIT_FAILURE, "[Memory Manager] pool %p is not linked back from the newer pool", (void*)current);
+
+				Block* cap = (Block*)(&current->block.block.data + poolBlockSize - offsetof(Block, size));
+				Block* block = &current->block;
+				Block* previous = nullptr;
+
+				while (block < cap)
+				{
+					bool free = (block->size & 1) != 0;
+					bool previousFree = previous && previous->size & 1;
+
+					RET_ON_ERR(!free && block->size & 4, EXIT_FAILURE, "[Memory Manager] block %p in a pool is flagged as a large mapping", (void*)block);
+					RET_ON_ERR(((block->size & 2) != 0) != previousFree, EXIT_FAILURE, "[Memory Manager] block %p disagrees with its neighbor about the neighbor being free", (void*)block);
+					RET_ON_ERR(previousFree && block->neighbor != previous, EXIT_FAILURE, "[Memory Manager] block %p points at the wrong free neighbor", (void*)block);
+					RET_ON_ERR(free && previousFree, EXIT_FAILURE, "[Memory Manager] block %p was not merged with its free neighbor", (void*)block);
+
+					if (free)
+					{
+						MapIndex index;
+						getIndex(blockSize(block), &index);
+
+						// the bin's list must lead to the block
+						RET_ON_ERR(block->block.free.prev ? block->block.free.prev->block.free.next != block : freeBlocks[index.bin] != block, EXIT_FAILURE, "[Memory Manager] free block %p is not in its bin", (void*)block);
+
+						++freeCount;
+						emptyCount += blockSize(block) == poolBlockSize;
+					}
+					else
+					{
+						SlabPage* page = (SlabPage*)&block->block.data;
+
+						// slab pages must describe a class they could hold
+						if (slabPageSize && !((uintptr_t)page & (slabPageSize - 1)) && page->check == ((uintptr_t)page ^ slabKey))
+						{
+							RET_ON_ERR(page->owner != this || page->sizeClass >= slabClasses || page->objectSize != slabClassSize(page->sizeClass), EXIT_FAILURE, "[Memory Manager] slab page %p has a bad header", (void*)page);
+							RET_ON_ERR(page->used > (slabPageSize - slabHeaderSize) / page->objectSize, EXIT_FAILURE, "[Memory Manager] slab page %p holds more objects than fit", (void*)page);
+						}
+					}
+
+					previous = block;
+					block = (Block*)((byte*)block + blockSize(block) + offsetof(Block, size));
+				}
+
+				RET_ON_ERR(block != cap, EXIT_FAILURE, "[Memory Manager] the blocks of pool %p run past its end", (void*)current);
+				RET_ON_ERR(blockSize(cap), EXIT_FAILURE, "[Memory Manager] the cap of pool %p was overwritten", (void*)current);
+			}
+
+			size_t listed = 0;
+
+			// every bin must hold only free blocks of its own sizes, and the masks must match the bins
+			for (size_t bin = 0; bin < binCount; ++bin)
+			{
+				size_t fl = bin / SLgranularity, sl = bin % SLgranularity;
+				Block* previous = nullptr;
+
+				for (Block* block = freeBlocks[bin]; block; previous = block, block = block->block.free.next)
+				{
+					MapIndex index;
+					getIndex(blockSize(block), &index);
+
+					// more blocks than the pools hold means the list loops
+					RET_ON_ERR(++listed > freeCount, EXIT_FAILURE, "[Memory Manager] the free lists hold more blocks than the pools");
+					RET_ON_ERR(!(block->size & 1), EXIT_FAILURE, "[Memory Manager] used block %p is in bin %zu", (void*)block, bin);
+					RET_ON_ERR(index.bin != (short)bin, EXIT_FAILURE, "[Memory Manager] block %p of size %zu is in bin %zu", (void*)block, blockSize(block), bin);
+					RET_ON_ERR(block->block.free.prev != previous, EXIT_FAILURE, "[Memory Manager] block %p in bin %zu links back to the wrong block", (void*)block, bin);
+				}
+
+				RET_ON_ERR(!freeBlocks[bin] != !(slMasks[fl] & (size_t)1 << sl), EXIT_FAILURE, "[Memory Manager] the second layer mask disagrees with bin %zu", bin);
+
+				if (!sl)
+				{
+					RET_ON_ERR(!slMasks[fl] != !(flMask & (size_t)1 << fl), EXIT_FAILURE, "[Memory Manager] the first layer mask disagrees with layer %zu", fl);
+				}
+			}
+
+			RET_ON_ERR(listed != freeCount, EXIT_FAILURE, "[Memory Manager] the pools hold %zu free blocks, the bins %zu", freeCount, listed);
+			RET_ON_ERR(emptyCount != emptyPools, EXIT_FAILURE, "[Memory Manager] %zu pools are empty, %zu are counted", emptyCount, emptyPools);
+
+			// every live handle must point at a used block that names it
+			for (uint32_t i = 0; i < handleCount; ++i)
+			{
+				byte* data = (byte*)handleSlot(i).data.load(std::memory_order_relaxed);
+				if (!data)
+					continue;
+
+				Block* block = (Block*)(data - sizeof(size_t) - offsetof(Block, block.data));
+				RET_ON_ERR(block->size & 1 || *(size_t*)&block->block.data != i, EXIT_FAILURE, "[Memory Manager] handle %u points at a block that does not hold it", i);
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::snapshot(const char* path, void* const* roots, size_t rootCount)
+		{
+			// there is nothing to write if this is true
+			RET_ON_ERR(!pool, EXIT_FAILURE, "[Memory Manager] snapshot of the non-initialized manager was attempted");
+
+			// this thread's cached blocks go back to the pools first
+			if (threaded)
+				for (ThreadCache& cache : localCaches.caches)
+					if (cache.owner == this)
+						releaseCache(&cache);
+
+			// the pools only hold still under the lock
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			Pool* oldest = pool;
+			size_t poolCount = 1;
+			for (; oldest->prevPool; oldest = oldest->prevPool)
+				++poolCount;
+
+			// a root outside the pools could not be brought back
+			for (size_t i = 0; i < rootCount; ++i)
+			{
+				Pool* current = oldest;
+				while (current && roots[i] && (uintptr_t)roots[i] - (uintptr_t)current >= poolSize)
+					current = current->nextPool;
+
+				RET_ON_ERR(roots[i] && !current, EXIT_FAILURE, "[Memory Manager] snapshot root %zu at %p is not in a pool", i, roots[i]);
+			}
+
+			SnapshotHeader header;
+			memset(&header, 0, sizeof(header));
+			header.magic = snapshotMagic;
+			header.version = snapshotVersion;
+			header.slBits = SLBits;
+			header.minBlock = MinBlock;
+			header.maxPool = MaxPool;
+			header.maxRequestSize = maxRequestSize;
+			header.poolSize = poolSize;
+			header.poolBlockSize = poolBlockSize;
+			header.slabPageSize = slabPageSize;
+			header.heap = (uintptr_t)this;
+			header.poolCount = poolCount;
+			header.rootCount = rootCount;
+			header.handleCount = handleCount;
+			header.freeHandles = freeHandles;
+			header.retainPools = retainPools;
+			header.expand = expand;
+			header.realTime = realTime;
+			header.pageType = pageType;
+			header.flMask = flMask;
+			memcpy(header.slMasks, slMasks, sizeof(slMasks));
+
+			for (size_t bin = 0; bin < binCount; ++bin)
+				header.freeBlocks[bin] = (uintptr_t)freeBlocks[bin];
+			for (byte sizeClass = 0; sizeClass < slabClasses; ++sizeClass)
+				header.slabPages[sizeClass] = (uintptr_t)slabPages[sizeClass];
+
+#if defined CHIROBAT_MEMORY_STATS
+			for (StatShard& shard : shards)
+			{
+				for (size_t i = 0; i < tagCount; ++i)
+				{
+					header.tagLive[i] += shard.tagLive[i].load(std::memory_order_relaxed);
+					header.tagAllocations[i] += shard.tagAllocations[i].load(std::memory_order_relaxed);
+					header.tagFrees[i] += shard.tagFrees[i].load(std::memory_order_relaxed);
+				}
+			}
+#endif
+
+			FILE* file = nullptr;
+#if defined _WIN32
+			fopen_s(&file, path, "wb");
+#else
+			file = fopen(path, "wb");
+#endif
+			RET_ON_ERR(!file, EXIT_FAILURE, "[Memory Manager] failed to open snapshot %s", path);
+
+			bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+			for (Pool* current = oldest; written && current; current = current->nextPool)
+			{
+				uintptr_t base = (uintptr_t)current;
+				written = fwrite(&base, sizeof(base), 1, file) == 1;
+			}
+
+			for (size_t i = 0; written && i < rootCount; ++i)
+			{
+				uintptr_t root = (uintptr_t)roots[i];
+				written = fwrite(&root, sizeof(root), 1, file) == 1;
+			}
+
+			for (uint32_t i = 0; written && i < handleCount; ++i)
+			{
+				HandleSlot& slot = handleSlot(i);
+
+				SnapshotSlot saved;
+				saved.data = (uintptr_t)slot.data.load(std::memory_order_relaxed);
+				saved.generation = slot.generation.load(std::memory_order_relaxed);
+				memcpy(&saved.next, &slot.next, sizeof(saved.next)); // the free list or the tag, whichever is in use
+
+				written = fwrite(&saved, sizeof(saved), 1, file) == 1;
+			}
+
+			for (Pool* current = oldest; written && current; current = current->nextPool)
+				written = fwrite(current, poolSize, 1, file) == 1;
+
+			written = !fclose(file) && written;
+			RET_ON_ERR(!written, EXIT_FAILURE, "[Memory Manager] failed to write snapshot %s", path);
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::restore(const char* path, bool threadCache, void** roots, size_t rootCount, bool* relocated)
+		{
+			// prevent over-initialization
+			RET_ON_ERR(pool, EXIT_FAILURE, "[Memory Manager] restore into the initialized manager was attempted");
+
+			// the pools are mapped before the file, which could otherwise take their old addresses
+			FILE* file = nullptr;
+#if defined _WIN32
+			fopen_s(&file, path, "rb");
+#else
+			file = fopen(path, "rb");
+#endif
+			RET_ON_ERR(!file, EXIT_FAILURE, "[Memory Manager] failed to open snapshot %s", path);
+
+			bool moved = false;
+			funcRet ret = mapSnapshotPools(file, threadCache, &moved);
+			fclose(file);
+
+			// only the pages of used blocks are ever read from the mapping
+			size_t imageSize = 0;
+			const byte* image = ret ? nullptr : (const byte*)Platform::mapFile(path, &imageSize);
+			if (image)
+			{
+				ret = restoreSnapshot(image, imageSize, roots, rootCount);
+				Platform::unmapFile(image, imageSize);
+			}
+			else
+				ret = EXIT_FAILURE;
+
+			if (ret)
+			{
+				unmapPools();
+				epoch = 0;
+			}
+			RET_ON_ERR(ret, EXIT_FAILURE, "[Memory Manager] failed to restore snapshot %s", path);
+
+			joinHeaps();
+
+			if (relocated)
+				*relocated = moved;
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::mapSnapshotPools(FILE* file, bool threadCache, bool* moved)
+		{
+			SnapshotHeader header;
+
+			RET_ON_ERR(fread(&header, sizeof(header), 1, file) != 1 || header.magic != snapshotMagic || header.version != snapshotVersion, EXIT_FAILURE, "[Memory Manager] the file is not a heap snapshot");
+			RET_ON_ERR(header.slBits != SLBits || header.minBlock != MinBlock || header.maxPool != MaxPool, EXIT_FAILURE, "[Memory Manager] the snapshot was taken by a heap of another tuning");
+
+			// the same sizing on this machine lays the pools out the same way
+			reset(header.maxRequestSize, header.expand != 0, threadCache, header.pageType);
+			RET_ON_ERR(poolSize != header.poolSize || poolBlockSize != header.poolBlockSize || slabPageSize != header.slabPageSize, EXIT_FAILURE, "[Memory Manager] the snapshot's pools do not fit this machine's pages");
+
+			retainPools = header.retainPools;
+			realTime = header.realTime;
+
+			// map every pool, at its old address if it is free, linked oldest to newest as addPool would
+			for (size_t i = 0; i < header.poolCount; ++i)
+			{
+				uintptr_t base;
+				RET_ON_ERR(fread(&base, sizeof(base), 1, file) != 1, EXIT_FAILURE, "[Memory Manager] the snapshot ends in its pool addresses");
+
+				Pool* temp = (Pool*)Platform::mapMemory(poolSize, pageType, (void*)base);
+				RET_ON_ERR(!temp, EXIT_FAILURE, "[Memory Manager] failed to map pool %zu of the snapshot", i);
+
+				*moved |= (uintptr_t)temp != base;
+
+				temp->prevPool = pool;
+				temp->nextPool = nullptr;
+				if (pool)
+					pool->nextPool = temp;
+				pool = temp;
+
+#if defined CHIROBAT_MEMORY_STATS
+				poolBytes += poolBlockSize;
+#endif
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::restoreSnapshot(const byte* file, size_t fileSize, void** roots, size_t rootCount)
+		{
+			const SnapshotHeader* header = (const SnapshotHeader*)file;
+
+			RET_ON_ERR(fileSize < sizeof(SnapshotHeader) || header->magic != snapshotMagic || header->version != snapshotVersion, EXIT_FAILURE, "[Memory Manager] the file is not a heap snapshot");
+			RET_ON_ERR(header->rootCount != rootCount, EXIT_FAILURE, "[Memory Manager] the snapshot holds %zu roots, %zu were asked for", header->rootCount, rootCount);
+
+			Pool* oldest = nullptr;
+			size_t poolCount = 0;
+			for (Pool* current = pool; current; current = current->prevPool, ++poolCount)
+				oldest = current;
+
+			RET_ON_ERR(!poolCount || poolCount != header->poolCount || poolCount > fileSize / poolSize, EXIT_FAILURE, "[Memory Manager] the snapshot's size does not match its pools");
+
+			// the tables ahead of the images, then the images fill the rest of the file exactly
+			size_t imagesAt = sizeof(SnapshotHeader) + (poolCount + rootCount) * sizeof(uintptr_t) + header->handleCount * sizeof(SnapshotSlot);
+			RET_ON_ERR(fileSize - poolCount * poolSize != imagesAt, EXIT_FAILURE, "[Memory Manager] the snapshot's size does not match its pools");
+
+			const uintptr_t* bases = (const uintptr_t*)(header + 1);
+			const uintptr_t* oldRoots = bases + poolCount;
+			const SnapshotSlot* slots = (const SnapshotSlot*)(oldRoots + rootCount);
+
+			Relocation relocation = { bases, oldest, poolCount };
+			funcRet ret = EXIT_SUCCESS;
+
+			const byte* images = file + imagesAt;
+			size_t index = 0;
+			for (Pool* current = oldest; !ret && current; current = current->nextPool, ++index)
+				ret = restorePool(images + index * poolSize, current, bases[index], relocation, header->heap);
+
+			// the free blocks array and the slab classes point into the pools
+			flMask = header->flMask;
+			memcpy(slMasks, header->slMasks, sizeof(slMasks));
+
+			for (size_t bin = 0; !ret && bin < binCount; ++bin)
+			{
+				freeBlocks[bin] = (Block*)header->freeBlocks[bin];
+				ret = relocate(relocation, freeBlocks[bin]);
+			}
+
+			for (byte sizeClass = 0; !ret && sizeClass < slabClasses; ++sizeClass)
+			{
+				slabPages[sizeClass] = (SlabPage*)header->slabPages[sizeClass];
+				ret = relocate(relocation, slabPages[sizeClass]);
+			}
+
+			// the handle table is mapped a page at a time, as handleMalloc would have
+			for (uint32_t i = 0; !ret && i < header->handleCount; ++i)
+			{
+				if (!(i % handlePageSlots))
+				{
+					HandleSlot* page = (HandleSlot*)Platform::mapMemory(sizeof(HandleSlot) * handlePageSlots, Platform::PageType::Standard);
+					if (!page)
+					{
+						ret = EXIT_FAILURE;
+						break;
+					}
+
+					handleTable[i / handlePageSlots].store(page, std::memory_order_relaxed);
+				}
+
+				void* data = (void*)slots[i].data;
+				ret = relocate(relocation, data);
+
+				HandleSlot& slot = handleSlot(i);
+				slot.data.store(data, std::memory_order_relaxed);
+				slot.generation.store(slots[i].generation, std::memory_order_relaxed);
+				memcpy(&slot.next, &slots[i].next, sizeof(slots[i].next));
+			}
+			handleCount = header->handleCount;
+			freeHandles = header->freeHandles;
+
+			for (size_t i = 0; !ret && roots && i < rootCount; ++i)
+			{
+				roots[i] = (void*)oldRoots[i];
+				ret = relocate(relocation, roots[i]);
+			}
+
+#if defined CHIROBAT_MEMORY_STATS
+			// the counters carry on from the snapshot, gathered in the first shard
+			for (size_t i = 0; i < tagCount; ++i)
+			{
+				shards[0].tagLive[i] = header->tagLive[i];
+				shards[0].tagAllocations[i] = header->tagAllocations[i];
+				shards[0].tagFrees[i] = header->tagFrees[i];
+			}
+
+			peakBytes = poolBytes - freeBytes;
+#endif
+
+			// a snapshot that made it this far is still checked before anything is allocated from it
+			if (!ret)
+				ret = checkHeap();
+
+			return ret;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::restorePool(const byte* image, Pool* to, uintptr_t base, const Relocation& relocation, uintptr_t heap)
+		{
+			size_t end = offsetof(Pool, block.block.data) + poolBlockSize - offsetof(Block, size); // where the cap sits
+			size_t at = offsetof(Pool, block);
+
+			for (;;)
+			{
+				const Block* from = (const Block*)(image + at);
+				Block* block = (Block*)((byte*)to + at);
+				size_t size = from->size & bitPackMask;
+
+				// the neighbor field is the end of the previous block's data, a pointer only while that block is free
+				block->size = from->size;
+				if (from->size & 2)
+				{
+					block->neighbor = from->neighbor;
+					RET_ON_ERR(relocate(relocation, block->neighbor), EXIT_FAILURE, "[Memory Manager] block %zu of the snapshot pool at %p has a neighbor outside the pools", at, (void*)base);
+				}
+
+				if (at == end) // the cap, it has no data
+					break;
+
+				RET_ON_ERR(!size || size > end - at - offsetof(Block, size), EXIT_FAILURE, "[Memory Manager] the blocks of the snapshot pool at %p run past its end", (void*)base);
+
+				if (from->size & 1) // free data is left as the OS mapped it, zero
+				{
+					block->size |= 4;
+					block->block.free = from->block.free;
+					RET_ON_ERR(relocate(relocation, block->block.free.prev) || relocate(relocation, block->block.free.next), EXIT_FAILURE, "[Memory Manager] free block %zu of the snapshot pool at %p links outside the pools", at, (void*)base);
+
+					if (at == offsetof(Pool, block) && size == poolBlockSize)
+						++emptyPools;
+
+#if defined CHIROBAT_MEMORY_STATS
+					freeBytes += size;
+#endif
+				}
+				else
+				{
+					memcpy(&block->block.data, &from->block.data, size);
+
+					// a slab page names its own old address and the old manager, both move here
+					SlabPage* page = (SlabPage*)&block->block.data;
+					uintptr_t oldPage = base + ((byte*)page - (byte*)to);
+					if (slabPageSize && !(oldPage & (slabPageSize - 1)) && page->check == (oldPage ^ slabKey) && (uintptr_t)page->owner == heap)
+					{
+						page->check = (uintptr_t)page ^ slabKey;
+						page->owner = this;
+
+						bool fixed = !relocate(relocation, page->prev) && !relocate(relocation, page->next) && !relocate(relocation, page->untouched);
+						for (void** object = &page->freeObjects; fixed && *object; object = (void**)*object)
+							fixed = !relocate(relocation, *object);
+
+						RET_ON_ERR(!fixed, EXIT_FAILURE, "[Memory Manager] slab page %zu of the snapshot pool at %p links outside the pools", at, (void*)base);
+					}
+				}
+
+				at += size + offsetof(Block, size);
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		template <class T>
+		funcRet TLSF_ALLOCATOR::relocate(const Relocation& relocation, T*& pointer)
+		{
+			if (!pointer)
+				return EXIT_SUCCESS;
+
+			Pool* current = relocation.oldest;
+			for (size_t i = 0; i < relocation.count; ++i, current = current->nextPool)
+			{
+				uintptr_t offset = (uintptr_t)pointer - relocation.bases[i];
+				if (offset < poolSize)
+				{
+					pointer = (T*)((byte*)current + offset);
+					return EXIT_SUCCESS;
+				}
+			}
+
+			return EXIT_FAILURE;
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::malloc(size_t size, Tag tag)
+		{
+			PROFILE_SCOPE("MemoryManager::malloc");
+
+			size += tagSize; // room to record the tag past the data
+
+			if (size > maxRequestSize) // too large for the pools, map it on its own
+			{
+				Block* block = largeMalloc(size, 0);
+				return countMalloc(block ? &block->block.data : nullptr, tag);
+			}
+
+			if (size != (size & bitPackMask)) // if the size is not aligned to the mask
+				size += (~size & ~bitPackMask) + 1; // align it to the mask
+
+			if (slabPageSize && size <= slabMaxSize) // small requests take a whole slab object
+				size = slabClassSize(slabClass(size));
+			else // ensure the size is at least minimum size
+				size = size < minBlockSize ? minBlockSize : size;
+
+			if (threaded)
+			{
+				MapIndex index; // small sizes are served from this thread's cache
+				getIndex(size, &index);
+
+				if (!index.fl)
+					return countMalloc(cacheMalloc(size, index.sl), tag);
+
+				std::lock_guard<std::mutex> guard(coreLock);
+				Block* block = coreMalloc(size);
+				return countMalloc(block ? &block->block.data : nullptr, tag);
+			}
+
+			return countMalloc(objectMalloc(size), tag);
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::calloc(size_t size, Tag tag)
+		{
+			PROFILE_SCOPE("MemoryManager::calloc");
+
+			size_t request = size + tagSize; // room to record the tag past the data
+
+			if (request > maxRequestSize) // a mapping of its own is already zero from the OS
+			{
+				Block* block = largeMalloc(request, 0);
+				return countMalloc(block ? &block->block.data : nullptr, tag);
+			}
+
+			if (request != (request & bitPackMask)) // if the size is not aligned to the mask
+				request += (~request & ~bitPackMask) + 1; // align it to the mask
+
+			if (slabPageSize && request <= slabMaxSize) // small requests take a whole slab object
+				request = slabClassSize(slabClass(request));
+			else // ensure the size is at least minimum size
+				request = request < minBlockSize ? minBlockSize : request;
+
+			MapIndex index;
+			getIndex(request, &index);
+
+			// slab objects and cached blocks are reused as they were left, clear them in full
+			if ((slabPageSize && request <= slabMaxSize) || (threaded && !index.fl))
+			{
+				void* ret = malloc(size, tag);
+
+				if (ret)
+					memset(ret, 0, size);
+
+				return ret;
+			}
+
+			bool zero;
+			Block* block;
+
+			if (threaded)
+			{
+				std::lock_guard<std::mutex> guard(coreLock);
+				block = coreMalloc(request, &zero);
+			}
+			else
+				block = coreMalloc(request, &zero);
+
+			if (!block)
+				return nullptr;
+
+			clearBlock(block, size, zero);
+
+			return countMalloc(&block->block.data, tag);
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::alignMalloc(size_t size, size_t align, Tag tag)
+		{
+			// the alignment must be a power of 2
+			RET_ON_ERR(!align || align & (align - 1), nullptr, "[Memory Manager] aligned malloc alignment of %zu is not a power of 2", align);
+
+			// every block is already aligned to the bit packing, nothing extra to do
+			if (align <= ~bitPackMask + 1)
+				return malloc(size, tag);
+
+			// slab objects past the 8 byte class sit on 16 byte boundaries, thread caches may mix in trimmed blocks that do not
+			if (align <= 16 && slabPageSize && size + tagSize <= slabMaxSize && !threaded)
+				return malloc(size < 16 ? 16 : size, tag);
+
+			size += tagSize; // room to record the tag past the data
+
+			Block* block;
+
+			// the worst case leading gap must fit in a pool alongside the request, otherwise map it on its own
+			if (align > maxRequestSize >> 1 || size > maxRequestSize - align - minBlockSize - sizeof(size_t))
+			{
+				block = largeMalloc(size, align);
+				return countMalloc(block ? &block->block.data : nullptr, tag);
+			}
+
+			if (size != (size & bitPackMask)) // if the size is not aligned to the mask
+				size += (~size & ~bitPackMask) + 1; // align it to the mask
+
+			// ensure the size is at least minimum size
+			size = size < minBlockSize ? minBlockSize : size;
+
+			if (threaded) // aligned blocks bypass the thread caches
+			{
+				std::lock_guard<std::mutex> guard(coreLock);
+				block = coreAlignMalloc(size, align);
+			}
+			else
+				block = coreAlignMalloc(size, align);
+
+			if (!block)
+				return nullptr;
+
+			return countMalloc(&block->block.data, tag);
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::alignCalloc(size_t size, size_t align, Tag tag)
+		{
+			// the alignment must be a power of 2
+			RET_ON_ERR(!align || align & (align - 1), nullptr, "[Memory Manager] aligned calloc alignment of %zu is not a power of 2", align);
+
+			// every block is already aligned to the bit packing, nothing extra to do
+			if (align <= ~bitPackMask + 1)
+				return calloc(size, tag);
+
+			// slab objects are reused as they were left, clear them in full
+			if (align <= 16 && slabPageSize && size + tagSize <= slabMaxSize && !threaded)
+			{
+				void* ret = alignMalloc(size, align, tag);
+
+				if (ret)
+					memset(ret, 0, size);
+
+				return ret;
+			}
+
+			size += tagSize; // room to record the tag past the data
+
+			Block* block;
+
+			// a mapping of its own is already zero from the OS
+			if (align > maxRequestSize >> 1 || size > maxRequestSize - align - minBlockSize - sizeof(size_t))
+			{
+				block = largeMalloc(size, align);
+				return countMalloc(block ? &block->block.data : nullptr, tag);
+			}
+
+			size_t request = size;
+			if (request != (request & bitPackMask)) // if the size is not aligned to the mask
+				request += (~request & ~bitPackMask) + 1; // align it to the mask
+
+			// ensure the size is at least minimum size
+			request = request < minBlockSize ? minBlockSize : request;
+
+			bool zero;
+
+			if (threaded) // aligned blocks bypass the thread caches
+			{
+				std::lock_guard<std::mutex> guard(coreLock);
+				block = coreAlignMalloc(request, align, &zero);
+			}
+			else
+				block = coreAlignMalloc(request, align, &zero);
+
+			if (!block)
+				return nullptr;
+
+			clearBlock(block, size, zero);
+
+			return countMalloc(&block->block.data, tag);
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::realloc(void* pointer, size_t size, Tag tag)
+		{
+			if (!pointer) // nothing to resize
+				return malloc(size, tag);
+
+			if (!size) // resizing to nothing is a free
+			{
+				free(pointer, tag);
+				return nullptr;
+			}
+
+			size += tagSize; // room to record the tag past the data
+
+			SlabPage* page = findSlab(pointer); // slab objects have no header of their own
+			Block* block = (Block*)((byte*)pointer - offsetof(Block, block.data));
+			size_t sizeBits = page ? 0 : loadSize(block); // read without the lock, the core may set the 0x2 bit under it
+			size_t oldSize = page ? page->objectSize : sizeBits & bitPackMask;
+
+#if defined CHIROBAT_MEMORY_STATS
+			tag = chargedTag(pointer, oldSize, tag); // the record goes once a shrunk block's tail is split off
+#endif
+
+			funcRet resized = EXIT_FAILURE;
+
+			if (page) // slab objects only stay put while they still fit
+				resized = size <= page->objectSize ? EXIT_SUCCESS : EXIT_FAILURE;
+			else if (sizeBits & 4 || size > maxRequestSize) // large blocks only stay put while they still fit, and stay large
+				resized = sizeBits & 4 && size > maxRequestSize && size <= oldSize ? EXIT_SUCCESS : EXIT_FAILURE;
+			else
+			{
+				if (size != (size & bitPackMask)) // if the size is not aligned to the mask
+					size += (~size & ~bitPackMask) + 1; // align it to the mask
+
+				// ensure the size is at least minimum size
+				size = size < minBlockSize ? minBlockSize : size;
+
+				if (threaded)
+				{
+					std::lock_guard<std::mutex> guard(coreLock);
+					resized = resizeBlock(block, size);
+				}
+				else
+					resized = resizeBlock(block, size);
+			}
+
+			if (!resized) // the block grew or shrank where it is
+				return countResize(pointer, oldSize, tag);
+
+			// no room in place, move the data to a new block
+			void* ret = malloc(size - tagSize, tag);
+			RET_ON_ERR(!ret, nullptr, "[Memory Manager] realloc failed to move a block to size %zu", size);
+
+			memcpy(ret, pointer, (size < oldSize ? size : oldSize) - tagSize); // the new block's tag is already recorded
+			free(pointer, tag);
+
+			return ret;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::free(void* pointer, Tag tag)
+		{
+			PROFILE_SCOPE("MemoryManager::free");
+
+			// avoid null pointers
+			RET_ON_ERR(!pointer, EXIT_FAILURE, "[Memory Manager] attempted to free a NULL pointer");
+
+			countFree(pointer, tag); // the size is only known while the block is still used
+
+			SlabPage* page = findSlab(pointer); // slab objects have no header of their own
+			Block* block = (Block*)((byte*)pointer - offsetof(Block, block.data));
+			size_t size = page ? page->objectSize : loadSize(block); // read without the lock, the masked size never changes
+
+			if (!page && size & 4) // a large block, hand it straight back to the OS
+				largeFree(block);
+			else if (threaded)
+			{
+				// small objects go to this thread's cache, whichever thread allocated them
+				// the cache holds at most two batches a bin, the rest drains back to this manager's core
+				MapIndex index;
+				getIndex(size & bitPackMask, &index);
+
+				if (!index.fl)
+					cacheFree(pointer, index.sl);
+				else
+				{
+					std::lock_guard<std::mutex> guard(coreLock);
+					coreFree(block);
+				}
+			}
+			else if (page)
+				slabFree(page, pointer);
+			else
+				coreFree(block);
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::mallocBatch(size_t count, size_t size, void** out, Tag tag)
+		{
+			PROFILE_SCOPE("MemoryManager::mallocBatch");
+
+			RET_ON_ERR(!out && count, EXIT_FAILURE, "[Memory Manager] batch malloc was given nowhere to put %zu pointers", count);
+
+			size += tagSize; // room to record the tag past the data
+
+			size_t done = 0;
+
+			if (size > maxRequestSize) // too large for the pools, each is mapped on its own
+			{
+				for (Block* block; done < count && (block = largeMalloc(size, 0)); ++done)
+					out[done] = &block->block.data;
+			}
+			else
+			{
+				if (size != (size & bitPackMask)) // if the size is not aligned to the mask
+					size += (~size & ~bitPackMask) + 1; // align it to the mask
+
+				// ensure the size is at least minimum size
+				size = size < minBlockSize ? minBlockSize : size;
+
+				// each block is followed by the next one's size, as many as fit a request are carved from each free block
+				size_t stride = size + sizeof(size_t);
+				size_t perBlock = (maxRequestSize + sizeof(size_t)) / stride;
+
+				std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+				if (threaded)
+					guard.lock();
+
+				while (done < count)
+				{
+					size_t carve = count - done < perBlock ? count - done : perBlock;
+
+					Block* block = coreMalloc(carve * stride - sizeof(size_t));
+					if (!block)
+						break;
+
+					size_t neighborFree = block->size & 2;
+					size_t total = blockSize(block);
+
+					// the blocks are used, none of them needs its neighbor, the last takes any slack the split left
+					for (size_t i = 0; i < carve; ++i)
+					{
+						Block* carved = (Block*)((byte*)block + i * stride);
+						carved->size = i + 1 < carve ? size : total - (carve - 1) * stride;
+						out[done + i] = &carved->block.data;
+					}
+
+					block->size |= neighborFree;
+					done += carve;
+				}
+			}
+
+			for (size_t i = 0; i < done; ++i)
+				countMalloc(out[i], tag);
+
+			if (done < count) // all or nothing
+				freeBatch(out, done, tag);
+
+			RET_ON_ERR(done < count, EXIT_FAILURE, "[Memory Manager] batch malloc failed after %zu of %zu blocks of size %zu", done, count, size);
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::freeBatch(void** pointers, size_t count, Tag tag)
+		{
+			PROFILE_SCOPE("MemoryManager::freeBatch");
+
+			RET_ON_ERR(!pointers && count, EXIT_FAILURE, "[Memory Manager] batch free was given no pointers");
+
+			for (size_t i = 0; i < count; ++i)
+				if (pointers[i])
+					countFree(pointers[i], tag); // the size is only known while the block is still used
+
+			// in address order, blocks carved or allocated back to back sit next to each other, a batch from mallocBatch mostly already is
+			if (!std::is_sorted(pointers, pointers + count))
+				std::sort(pointers, pointers + count);
+
+			// small objects go straight to the core, the lock is taken once for the batch
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			Block* run = nullptr; // the used block the blocks after it are merged into, freed as one
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (!pointers[i])
+					continue;
+
+				SlabPage* page = findSlab(pointers[i]);
+				Block* block = (Block*)((byte*)pointers[i] - offsetof(Block, block.data));
+
+				if (page)
+					slabFree(page, pointers[i]);
+				else if (block->size & 4) // a large block, hand it straight back to the OS
+					largeFree(block);
+				else if (run && (byte*)run + blockSize(run) + offsetof(Block, size) == (byte*)block)
+					run->size += sizeof(block->size) + blockSize(block); // the next block of the run, its header becomes data
+				else
+				{
+					if (run)
+						coreFree(run);
+					run = block;
+				}
+			}
+
+			if (run)
+				coreFree(run);
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		Handle TLSF_ALLOCATOR::handleMalloc(size_t size, Tag tag)
+		{
+			// handle blocks must stay in the pools to be moved
+			RET_ON_ERR(size > maxRequestSize - sizeof(size_t) - tagSize, noHandle, "[Memory Manager] handle malloc size request of %zu is beyond the pools", size);
+
+			size += sizeof(size_t) + tagSize; // room for the slot index ahead of the data, and the tag past it
+
+			if (size != (size & bitPackMask)) // if the size is not aligned to the mask
+				size += (~size & ~bitPackMask) + 1; // align it to the mask
+
+			// ensure the size is at least minimum size
+			size = size < minBlockSize ? minBlockSize : size;
+
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			// reuse a freed slot, or take the next one, mapping its page if it is the first
+			uint32_t index = freeHandles;
+			if (index == noSlot)
+			{
+				RET_ON_ERR(handleCount == handlePages * handlePageSlots, noHandle, "[Memory Manager] the handle table is full");
+
+				if (!(handleCount % handlePageSlots))
+				{
+					HandleSlot* page = (HandleSlot*)Platform::mapMemory(sizeof(HandleSlot) * handlePageSlots, Platform::PageType::Standard);
+					RET_ON_ERR(!page, noHandle, "[Memory Manager] failed to map a page of the handle table");
+
+					for (size_t i = 0; i < handlePageSlots; ++i)
+					{
+						page[i].data.store(nullptr, std::memory_order_relaxed);
+						page[i].generation.store(0, std::memory_order_relaxed);
+					}
+
+					handleTable[handleCount / handlePageSlots].store(page, std::memory_order_release);
+				}
+
+				index = handleCount++;
+			}
+			else
+				freeHandles = handleSlot(index).next;
+
+			HandleSlot& slot = handleSlot(index);
+
+			Block* block = coreMalloc(size);
+			if (!block) // give the slot back
+			{
+				slot.next = freeHandles;
+				freeHandles = index;
+				return noHandle;
+			}
+
+			*(size_t*)&block->block.data = index;
+			slot.tag = tag;
+			slot.data.store(&block->block.data + sizeof(size_t), std::memory_order_release);
+
+			countMalloc(&block->block.data, tag);
+
+			Handle ret = { index, slot.generation.load(std::memory_order_relaxed) };
+			return ret;
+		}
+
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::handleFree(Handle handle)
+		{
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			void* data = handle.index < handleCount ? resolve(handle) : nullptr;
+			RET_ON_ERR(!data, EXIT_FAILURE, "[Memory Manager] attempted to free a stale handle");
+
+			Block* block = (Block*)((byte*)data - sizeof(size_t) - offsetof(Block, block.data));
+			countFree(&block->block.data, handleSlot(handle.index).tag);
+
+			// stale copies of the handle stop resolving before the block goes back
+			HandleSlot& slot = handleSlot(handle.index);
+			slot.data.store(nullptr, std::memory_order_relaxed);
+			slot.generation.store(handle.generation + 1, std::memory_order_release);
+			slot.next = freeHandles;
+			freeHandles = handle.index;
+
+			coreFree(block);
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::resolve(Handle handle)
+		{
+			if (handle.index >= handlePages * handlePageSlots)
+				return nullptr;
+
+			HandleSlot* page = handleTable[handle.index / handlePageSlots].load(std::memory_order_acquire);
+			if (!page)
+				return nullptr;
+
+			HandleSlot& slot = page[handle.index % handlePageSlots];
+			if (slot.generation.load(std::memory_order_acquire) != handle.generation)
+				return nullptr;
+
+			return slot.data.load(std::memory_order_acquire);
+		}
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::compact(size_t budget)
+		{
+			PROFILE_SCOPE("MemoryManager::compact");
+
+			// there is nothing to compact if this is true
+			RET_ON_ERR(!pool, 0, "[Memory Manager] compaction of the non-initialized manager was attempted");
+
+			std::unique_lock<std::mutex> guard(coreLock, std::defer_lock);
+			if (threaded)
+				guard.lock();
+
+			size_t moved = 0;
+
+			for (;;)
+			{
+				// find the pool to resume at, counting from the oldest, pools may have been released since
+				Pool* current = pool;
+				while (current->prevPool)
+					current = current->prevPool;
+				for (size_t i = 0; current && i < compactPool; ++i)
+					current = current->nextPool;
+
+				if (!current) // a pass over the pools is done
+				{
+					compactPool = 0;
+
+					// a whole pass moved nothing, the heap is as compact as it gets
+					if (!lapMoved)
+						return moved;
+
+					lapMoved = 0;
+					continue;
+				}
+
+				bool done;
+				size_t step = slidePool(current, moved < budget ? budget - moved : 0, done);
+
+				// a pool slid to the end holds its handles packed at its start, it may be emptied
+				if (done)
+				{
+					size_t evacuated = evacuatePool(current);
+					step += evacuated;
+
+					if (!evacuated) // an emptied pool may be gone, the next pool takes its index
+						++compactPool;
+				}
+
+				moved += step;
+				lapMoved += step;
+
+				if (moved && moved >= budget)
+					return moved;
+			}
+		}
+
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::Block* TLSF_ALLOCATOR::coreMalloc(size_t size, bool* zero)
+		{
+			Block* block = getBlock(size); // attempt to get a block
+			if (!block) // no block found
+			{
+				// add a pool
+				RET_ON_ERR(addPool(), nullptr, "[Memory Manager] malloc failed to allocate block of size %zu", size);
+				block = getBlock(size); // get the new block
+			}
+
+			splitBlock(block, size); // split if possible, to maximise memory usage
+			removeBlock(block); // remove this block from the free blocks array
+
+			// a used block in a pool never carries the flag, it would read as a large mapping
+			if (zero)
+				*zero = (block->size & 4) != 0;
+			block->size &= ~(size_t)4;
+
+#if defined CHIROBAT_MEMORY_STATS
+			peakBytes = poolBytes - freeBytes > peakBytes ? poolBytes - freeBytes : peakBytes;
+#endif
+
+			return block;
+		}
+
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::Block* TLSF_ALLOCATOR::coreAlignMalloc(size_t size, size_t align, bool* zero)
+		{
+			// a block this large holds the request after any leading gap
+			size_t searchSize = size + align + minBlockSize + sizeof(size_t);
+
+			Block* block = getBlock(searchSize); // attempt to get a block
+			if (!block) // no block found
+			{
+				// add a pool
+				RET_ON_ERR(addPool(), nullptr, "[Memory Manager] aligned malloc failed to allocate block of size %zu", searchSize);
+				block = getBlock(searchSize); // get the new block
+			}
+
+			// distance from the block's data to the next aligned address
+			size_t gap = (size_t)(0 - (uintptr_t)&block->block.data) & (align - 1);
+
+			// the gap has to be big enough to become a free block of its own
+			while (gap && gap < minBlockSize + sizeof(size_t))
+				gap += align;
+
+			if (gap) // split the leading gap off, back into the free blocks array
+			{
+				size_t oldSize = blockSize(block);
+				size_t fresh = block->size & 4; // both halves stay as zero as the original
+				removeBlock(block);
+
+				Block* aligned = (Block*)((byte*)block + gap);
+				block->size = (gap - sizeof(size_t)) | fresh; // the gap keeps the original header
+				aligned->size = (oldSize - gap) | fresh; // the aligned block ends where the original did
+
+				addBlock(block);
+				addBlock(aligned);
+				block = aligned;
+			}
+
+			splitBlock(block, size); // return the trailing space
+			removeBlock(block); // remove this block from the free blocks array
+
+			// a used block in a pool never carries the flag, it would read as a large mapping
+			if (zero)
+				*zero = (block->size & 4) != 0;
+			block->size &= ~(size_t)4;
+
+#if defined CHIROBAT_MEMORY_STATS
+			peakBytes = poolBytes - freeBytes > peakBytes ? poolBytes - freeBytes : peakBytes;
+#endif
+
+			return block;
+		}
+
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::Block* TLSF_ALLOCATOR::largeMalloc(size_t size, size_t align)
+		{
+			// room for the mapping size, the header, and the worst case alignment gap ahead of the data
+			size_t reserve = sizeof(size_t) + offsetof(Block, block.data) + align;
+			RET_ON_ERR(size > ~(size_t)0 - reserve - Platform::pageSize(), nullptr, "[Memory Manager] malloc size request of %zu cannot be mapped", size);
+
+			// huge pages are only worth it once the request fills one
+			Platform::PageType pages = size >= Platform::hugePageSize() ? pageType : Platform::PageType::Standard;
+			size_t mapSize = Platform::mappingSize(reserve + size, pages);
+
+			byte* map = (byte*)Platform::mapMemory(mapSize, pages);
+			RET_ON_ERR(!map, nullptr, "[Memory Manager] failed to map a large block of size %zu", size);
+			*(size_t*)map = mapSize; // the mapping remembers its own size
+
+#if defined CHIROBAT_MEMORY_STATS
+			largeBytes += mapSize;
+#endif
 
-			// clamp the pool to allow the block to fit
-			poolSize = poolSize < sizeof(Pool) ? sizeof(Pool) : poolSize;
+			// place the data on the alignment, just past the mapping size and header
+			uintptr_t data = (uintptr_t)map + sizeof(size_t) + offsetof(Block, block.data);
+			if (align)
+				data = (data + align - 1) & ~(uintptr_t)(align - 1);
 
-			// determine the maximum first layer size (un-adjusted)
-			byte FLmax = findMSB(poolSize);
+			Block* block = (Block*)(data - offsetof(Block, block.data));
+			block->neighbor = (Block*)map; // there is no physical neighbor, point at the mapping instead
+			block->size = (((uintptr_t)map + mapSize - data) & bitPackMask) | 4; // the whole tail is usable
 
-			// find the largest block allowed in the free blocks array
-			maxRequestSize = (((size_t)1 << (FLmax + 1)) - 1) & bitPackMask;
-			// and minimum
-			minBlockSize = sizeof(Block*) * 3;
+			return block;
+		}
 
-			// calculate the adjusted layer sizes
-			MapIndex index;
-			getIndex(maxRequestSize, &index);
-			FLmax = index.fl;
-
-			// how big a pool needs to be to accomodate the block data, rewuested size, and fake block at the end
-			this->poolSize = offsetof(Block, block.data) + maxRequestSize + sizeof(size_t);
-
-			// allocate the structure onto the system HEAP
-			// TODO move this into the front of the pool
-			freeBlocks = (Block**)_mm_malloc((FLmax + 1) * SLgranularity * sizeof(Block*), alignof(Block*));
-			slMasks = (size_t*)_mm_malloc((FLmax + 1) * sizeof(size_t), alignof(size_t));
-			memset(freeBlocks, 0, (FLmax + 1) * SLgranularity * sizeof(Block*));
-			memset(slMasks, 0, (FLmax + 1) * sizeof(size_t));
-			flMask = 0;
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::largeFree(Block* block)
+		{
+			byte* map = (byte*)block->neighbor;
 
-			// allocate a pool on the system HEAP
-			this->expand = expand;
-			pool = nullptr;
-			addPool();
+#if defined CHIROBAT_MEMORY_STATS
+			largeBytes -= *(size_t*)map;
+#endif
 
-			return EXIT_SUCCESS;
+			Platform::unmapMemory(map, *(size_t*)map);
 		}
 
-		funcRet MemoryManager::shutDown()
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::clearBlock(Block* block, size_t size, bool zero)
 		{
-			// there is nothing to shut down if this is true
-			RET_ON_ERR(!pool, EXIT_FAILURE, "[Memory Manager] shutdown of the non-initialized manager was attempted");
+			byte* data = &block->block.data;
 
-			// run through the pool list
-			Pool* temp;
-			while (pool->prevPool) // while there is a previous pool
+			if (!zero)
 			{
-				temp = pool->prevPool; // track where you are
-				_mm_free(pool); // free this pool
-				pool = temp; // move to the tracker
+				clearMemory(data, size);
+				return;
 			}
 
-			// free the structure
-			_mm_free(pool);
-			_mm_free(freeBlocks);
-			_mm_free(slMasks);
+			// only the words the free blocks array kept in the block were ever written
+			memset(data, 0, size < sizeof(FreeList) ? size : sizeof(FreeList));
 
-			// the pool is now officially gone
-			pool = nullptr;
+			size_t last = blockSize(block) - sizeof(Block*); // the next block's neighbor field
+			if (last < size)
+				memset(data + last, 0, size - last);
+		}
 
-			return EXIT_SUCCESS;
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::coreFree(Block* block)
+		{
+			if (block->size & 2) // is the previous neighbor free?
+			{
+				removeBlock(block->neighbor); // remove it from the free blocks array
+				block->neighbor->size += sizeof(block->size) + blockSize(block); // expand it to encapsulate this block
+				block->neighbor->size &= ~(size_t)4; // the used data it took in is not zero
+				block = block->neighbor; // move to it
+			}
+
+			Block* next;
+
+			// get the next block, and check if it is free
+			if (!getNextBlock(block, &next) && next->size & 1)
+			{
+				removeBlock(next); // remove it
+				block->size += sizeof(next->size) + blockSize(next); // encapsulate it
+			}
+
+			addBlock(block); // add this block to the free blocks array
+
+			// too many pools sit empty, give this one back, keeping at least one pool
+			if (blockSize(block) == poolBlockSize && emptyPools > retainPools && (pool->prevPool || pool->nextPool))
+				releasePool((Pool*)((byte*)block - offsetof(Pool, block)));
 		}
 
-		void* MemoryManager::malloc(size_t size)
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::resizeBlock(Block* block, size_t size)
 		{
-			if (size != (size & bitPackMask)) // if the size is not aligned to the mask
-				size += (~size & ~bitPackMask) + 1; // align it to the mask
+			if (size > blockSize(block)) // growing, only possible into a free next neighbor
+			{
+				Block* next;
 
-			// the size exceeds the tolerated range
-			RET_ON_ERR(size > maxRequestSize, nullptr, "[Memory Manager] malloc size request of %zu exceeds maximum request size of %zu", size, maxRequestSize);
+				// there must be a free next block, big enough to cover the difference
+				if (getNextBlock(block, &next) || !(next->size & 1) || blockSize(block) + sizeof(next->size) + blockSize(next) < size)
+					return EXIT_FAILURE;
 
-			// ensure the size is at least minimum size
-			size = size < minBlockSize ? minBlockSize : size;
+				removeBlock(next); // remove it
+				block->size += sizeof(next->size) + blockSize(next); // encapsulate it
+			}
 
-			Block* block = getBlock(size); // attempt to get a block
-			if (!block) // no block found
+			// trim the tail if there is room for a free block of its own
+			if (blockSize(block) - size >= minBlockSize + sizeof(size_t))
 			{
-				// add a pool
-				RET_ON_ERR(addPool(), nullptr, "[Memory Manager] malloc failed to allocate block of size %zu", size);
-				block = getBlock(size); // get the new block
+				size_t oldSize = blockSize(block);
+				block->size = size | (block->size & 2); // keep the neighbor flag
+
+				Block* tail;
+				getNextBlock(block, &tail);
+				tail->size = oldSize - size - sizeof(size_t); // its neighbor, this block, is used
+
+				coreFree(tail); // merge it with a free next neighbor and file it
 			}
-			
-			splitBlock(block, size); // split if possible, to maximise memory usage
-			removeBlock(block); // remove this block from the free blocks array
-			
-			return &block->block.data; // give the user the pointer to the data portion of the block
+
+#if defined CHIROBAT_MEMORY_STATS
+			peakBytes = poolBytes - freeBytes > peakBytes ? poolBytes - freeBytes : peakBytes;
+#endif
+
+			return EXIT_SUCCESS;
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::objectMalloc(size_t size)
+		{
+			if (slabPageSize && size <= slabMaxSize)
+				return slabMalloc(slabClass(size));
+
+			Block* block = coreMalloc(size);
+			return block ? &block->block.data : nullptr;
 		}
 
-		void* MemoryManager::calloc(size_t size)
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::objectFree(void* pointer)
 		{
-			void* ret = malloc(size); // malloc the request
+			SlabPage* page = findSlab(pointer);
+
+			if (page)
+				slabFree(page, pointer);
+			else
+				coreFree((Block*)((byte*)pointer - offsetof(Block, block.data)));
+		}
 
-			if (ret) // if it succeeded
-				memset(ret, 0, size); // memset to 0
+		TLSF_TEMPLATE
+		byte TLSF_ALLOCATOR::slabClass(size_t size)
+		{
+			return size <= 8 ? 0 : (byte)((size + 15) >> 4);
+		}
 
-			return ret;
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::slabClassSize(byte sizeClass)
+		{
+			return sizeClass ? (size_t)sizeClass << 4 : 8;
 		}
 
-		void* MemoryManager::alignMalloc(size_t size, size_t align)
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::SlabPage* TLSF_ALLOCATOR::findSlab(void* pointer)
 		{
-			RET_ON_ERR(1, nullptr, "[Memory Manager] aligned malloc is not yet implemented, no address will be given out");
+			if (!slabPageSize) // no slabs in use
+				return nullptr;
+
+			// every pool and large mapping starts on an OS page, so the page holding any pointer is readable
+			SlabPage* page = (SlabPage*)((uintptr_t)pointer & ~(uintptr_t)(slabPageSize - 1));
 
-			return nullptr;
+			// objects sit past the header, a page aligned pointer is never one of them
+			if ((void*)page == pointer || page->check != ((uintptr_t)page ^ slabKey) || page->owner != this)
+				return nullptr;
+
+			return page;
 		}
 
-		void* MemoryManager::alignCalloc(size_t size, size_t align)
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::slabMalloc(byte sizeClass)
 		{
-			void* ret = alignMalloc(size, align);
+			SlabPage* page = slabPages[sizeClass];
 
-			if (ret)
-				memset(ret, 0, size);
+			if (!page) // no room in this class, carve a new page from the core
+			{
+				Block* block = coreAlignMalloc(slabPageSize, slabPageSize);
+				RET_ON_ERR(!block, nullptr, "[Memory Manager] failed to allocate a slab page for objects of size %zu", slabClassSize(sizeClass));
+
+				page = (SlabPage*)&block->block.data;
+				page->check = (uintptr_t)page ^ slabKey;
+				page->owner = this;
+				page->prev = nullptr;
+				page->next = nullptr;
+				page->freeObjects = nullptr;
+				page->untouched = (byte*)page + slabHeaderSize;
+				page->used = 0;
+				page->objectSize = (unsigned short)slabClassSize(sizeClass);
+				page->sizeClass = sizeClass;
+
+				slabPages[sizeClass] = page;
+			}
+
+			void* ret;
+
+			if (page->freeObjects) // reuse a freed object first
+			{
+				ret = page->freeObjects;
+				page->freeObjects = *(void**)ret;
+			}
+			else // then carve from the untouched tail
+			{
+				ret = page->untouched;
+				page->untouched += page->objectSize;
+			}
+
+			++page->used;
+
+			// the page is full, it leaves its class until an object comes back
+			if (!page->freeObjects && page->untouched + page->objectSize > (byte*)page + slabPageSize)
+			{
+				slabPages[sizeClass] = page->next;
+				if (page->next)
+					page->next->prev = nullptr;
+			}
 
 			return ret;
 		}
 
-		funcRet MemoryManager::free(void* pointer)
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::slabFree(SlabPage* page, void* pointer)
 		{
-			// avoid null pointers
-			RET_ON_ERR(!pointer, EXIT_FAILURE, "[Memory Manager] attempted to free a NULL pointer");
+			// a full page is not in its class, it rejoins once this object is back
+			bool full = !page->freeObjects && page->untouched + page->objectSize > (byte*)page + slabPageSize;
 
-			// extract the block from the pointer
-			Block* block = (Block*)((byte*)pointer - offsetof(Block, block.data));
-			
-			if (block->size & 2) // is the previous neighbor free?
+			*(void**)pointer = page->freeObjects;
+			page->freeObjects = pointer;
+			--page->used;
+
+			if (full)
 			{
-				removeBlock(block->neighbor); // remove it from the free blocks array
-				block->neighbor->size += sizeof(block->size) + blockSize(block); // expand it to encapsulate this block
-				block = block->neighbor; // move to it
+				page->prev = nullptr;
+				page->next = slabPages[page->sizeClass];
+				if (page->next)
+					page->next->prev = page;
+				slabPages[page->sizeClass] = page;
+			}
+			else if (!page->used && (page->prev || page->next)) // empty, and not the last page of its class
+			{
+				if (page->prev)
+					page->prev->next = page->next;
+				else
+					slabPages[page->sizeClass] = page->next;
+				if (page->next)
+					page->next->prev = page->prev;
+
+				page->check = 0; // no longer a slab page
+				coreFree((Block*)((byte*)page - offsetof(Block, block.data)));
 			}
+		}
 
-			Block* next;
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::ThreadCache* TLSF_ALLOCATOR::getCache()
+		{
+			CacheTable* table = &localCaches;
+			size_t current = epoch;
 
-			// get the next block, and check if it is free
-			if (!getNextBlock(block, &next) && next->size & 1)
+			// a thread mostly sticks to one heap at a time
+			ThreadCache* ret = &table->caches[table->last];
+			if (ret->owner == this && ret->epoch == current)
+				return ret;
+
+			ThreadCache* unbound = nullptr;
+
+			for (byte slot = 0; slot < CacheTable::cacheSlots; ++slot)
 			{
-				removeBlock(next); // remove it
-				block->size += sizeof(next->size) + blockSize(next); // encapsulate it
+				ret = &table->caches[slot];
+
+				if (ret->owner == this && ret->epoch == current)
+				{
+					table->last = slot;
+					return ret;
+				}
+
+				if (!unbound && (!ret->owner || ret->owner == this)) // free, or this heap's from an older epoch
+				{
+					unbound = ret;
+					table->last = slot;
+				}
 			}
 
-			addBlock(block); // add this block to the free blocks array
+			// every slot serves another heap, give the oldest binding back to its owner
+			if (!unbound)
+			{
+				table->last = table->victim;
+				table->victim = (table->victim + 1) % CacheTable::cacheSlots;
+				unbound = &table->caches[table->last];
+			}
 
-			return EXIT_SUCCESS;
+			releaseCache(unbound);
+
+			memset(unbound->bins, 0, sizeof(unbound->bins));
+			memset(unbound->counts, 0, sizeof(unbound->counts));
+			unbound->owner = this;
+			unbound->epoch = current;
+
+			return unbound;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::releaseCache(ThreadCache* cache)
+		{
+			if (!cache->owner)
+				return;
+
+			// the owner may have shut down or been destroyed, only touch it if it is still live in the cache's epoch
+			std::lock_guard<std::mutex> registry(registryLock);
+
+			for (TLSFAllocator* heap = heaps; heap; heap = heap->nextHeap)
+			{
+				if (heap != cache->owner || heap->epoch != cache->epoch)
+					continue;
+
+				std::lock_guard<std::mutex> guard(heap->coreLock);
+				for (byte sl = 0; sl < SLgranularity; ++sl)
+					heap->drainCache(cache, sl, cache->counts[sl]);
+
+				break;
+			}
+
+			cache->owner = nullptr;
+		}
+
+		TLSF_TEMPLATE
+		void* TLSF_ALLOCATOR::cacheMalloc(size_t size, byte sl)
+		{
+			ThreadCache* local = getCache();
+
+			if (!local->bins[sl]) // empty bin, refill it in one trip to the core
+			{
+				// keep a batch to roughly half a pool so refills do not force expansion
+				size_t count = (maxRequestSize >> 1) / size;
+				count = count < 1 ? 1 : count > ThreadCache::batchSize ? ThreadCache::batchSize : count;
+
+				std::lock_guard<std::mutex> guard(coreLock);
+
+				while (count--)
+				{
+					void* object = objectMalloc(size);
+					if (!object)
+						break;
+
+					MapIndex index; // a block that could not be split may belong to a larger bin
+					getIndex(slabPageSize && size <= slabMaxSize ? size : blockSize((Block*)((byte*)object - offsetof(Block, block.data))), &index);
+
+					if (index.fl)
+					{
+						objectFree(object);
+						break;
+					}
+
+					*(void**)object = local->bins[index.sl];
+					local->bins[index.sl] = object;
+					++local->counts[index.sl];
+				}
+
+				// still nothing that fits, serve this request straight from the core
+				if (!local->bins[sl])
+					return objectMalloc(size);
+			}
+
+			void* object = local->bins[sl]; // pop the head of the bin
+			local->bins[sl] = *(void**)object;
+			--local->counts[sl];
+
+			return object;
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::cacheFree(void* pointer, byte sl)
+		{
+			ThreadCache* local = getCache();
+
+			*(void**)pointer = local->bins[sl]; // push onto the head of the bin
+			local->bins[sl] = pointer;
+
+			// too many objects held, give a batch back so other threads can use them
+			if (++local->counts[sl] > ThreadCache::batchSize * 2)
+			{
+				std::lock_guard<std::mutex> guard(coreLock);
+				drainCache(local, sl, ThreadCache::batchSize);
+			}
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::drainCache(ThreadCache* cache, byte sl, size_t count)
+		{
+			while (count-- && cache->bins[sl])
+			{
+				void* object = cache->bins[sl];
+				cache->bins[sl] = *(void**)object;
+				--cache->counts[sl];
+
+				objectFree(object);
+			}
 		}
 
-		funcRet MemoryManager::addPool()
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::addPool()
 		{
+			PROFILE_SCOPE("MemoryManager::addPool");
+
 			// check if expansion is valid
 			RET_ON_ERR(!expand && pool, EXIT_FAILURE, "[Memory Manager] the allocator is set to not expand, no more memory can be added");
 			RET_ON_ERR(!poolSize, EXIT_FAILURE, "[Memory Manager] attempted to expand the pool chain with no pool size");
 
-			// allocate a new pool on the system HEAP
-			Pool* temp = (Pool*)_mm_malloc(poolSize, alignof(Pool*));
+			// map a new pool straight from the OS
+			Pool* temp = (Pool*)Platform::mapMemory(poolSize, pageType);
 			RET_ON_ERR(!temp, EXIT_FAILURE, "[Memory Manager] failed to allocate new memory pool");
 			temp->prevPool = pool; // link it to the current pool
+			temp->nextPool = nullptr;
+			if (pool)
+				pool->nextPool = temp;
 			pool = temp; // make it the current pool
 
-			// add the pool to the free blocks array
-			pool->block.size = maxRequestSize;
+			// cap off the pool to prevent the "next block" code from overstepping the pool
+			*(size_t*)(&pool->block.block.data + poolBlockSize) = 0; // fake block of size 0
+
+			// add the pool to the free blocks array, its data is zero from the OS
+			pool->block.size = poolBlockSize | 4;
 			addBlock(&pool->block);
 
-			// cap off the pool to prevent the "next block" code from overstepping the pool
-			*(size_t*)((byte*)pool + poolSize - sizeof(size_t)) = 0; // fake block of size 0
+#if defined CHIROBAT_MEMORY_STATS
+			poolBytes += poolBlockSize;
+#endif
 
 			return EXIT_SUCCESS;
 		}
 
-		void MemoryManager::addBlock(Block* block)
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::releasePool(Pool* empty)
+		{
+			removeBlock(&empty->block); // its only block leaves the free blocks array
+
+#if defined CHIROBAT_MEMORY_STATS
+			poolBytes -= poolBlockSize;
+#endif
+
+			// unlink it from the pool list
+			if (empty->prevPool)
+				empty->prevPool->nextPool = empty->nextPool;
+			if (empty->nextPool)
+				empty->nextPool->prevPool = empty->prevPool;
+			else
+				pool = empty->prevPool; // it was the tail
+
+			Platform::unmapMemory(empty, poolSize);
+		}
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::slidePool(Pool* current, size_t budget, bool& done)
+		{
+			Block* block = &current->block;
+			size_t moved = 0;
+			done = false;
+
+			for (;;)
+			{
+				Block* next;
+				if (getNextBlock(block, &next)) // the cap, the whole pool was walked
+				{
+					done = true;
+					return moved;
+				}
+
+				// only a free block followed by a handle block can be closed up
+				if (!(block->size & 1) || !isHandle(next))
+				{
+					block = next;
+					continue;
+				}
+
+				if (moved && moved >= budget)
+					return moved;
+
+				// swap them, the handle block takes the free block's place and the free block follows it
+				// the free block's neighbor field is the end of the used block before it, it must not be written
+				size_t freeSize = blockSize(block);
+				size_t handleSize = blockSize(next);
+				removeBlock(block);
+
+				byte* data = &next->block.data;
+				memmove(&block->block.data, data, handleSize);
+				block->size = handleSize; // used, after a used block
+
+				Block* hole = (Block*)((byte*)block + handleSize + offsetof(Block, size));
+				hole->size = freeSize; // used for now, after the handle block
+				coreFree(hole); // merge it with a free next neighbor and file it
+
+				handleSlot((uint32_t)*(size_t*)&block->block.data).data.store(&block->block.data + sizeof(size_t), std::memory_order_release);
+				moved += handleSize;
+
+				// the hole carries on up the pool, in front of whatever follows it now
+				block = hole;
+			}
+		}
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::evacuatePool(Pool* current)
+		{
+			// the last pool stays
+			if (!current->prevPool && !current->nextPool)
+				return 0;
+
+			// after sliding, the pool is its handle blocks then at most one free block, if it holds nothing else
+			Block* block = &current->block;
+			Block* tail = nullptr;
+			size_t used = 0;
+
+			for (Block* next; ; block = next)
+			{
+				bool last = getNextBlock(block, &next) != EXIT_SUCCESS;
+
+				if (block->size & 1)
+				{
+					if (!last) // a hole before a used block, something other than a handle is in the pool
+						return 0;
+					tail = block;
+				}
+				else if (!isHandle(block))
+					return 0;
+				else
+					++used;
+
+				if (last)
+					break;
+			}
+
+			if (!used) // an empty pool is left to the retention
+				return 0;
+
+			// keep the pool's own free space out of reach while its blocks find new homes
+			if (tail)
+				removeBlock(tail);
+
+			Block* end = tail ? tail : (Block*)((byte*)block + blockSize(block) + offsetof(Block, size));
+			size_t moved = 0;
+
+			for (block = &current->block; block != end; block = (Block*)((byte*)block + blockSize(block) + offsetof(Block, size)))
+			{
+				size_t size = blockSize(block);
+				Block* to = findBlock(size);
+
+				// moving into an empty pool only trades one pool for another
+				if (!to || blockSize(to) == poolBlockSize)
+				{
+					// put back what already moved, the old blocks still hold their data
+					for (Block* undo = &current->block; undo != block; undo = (Block*)((byte*)undo + blockSize(undo) + offsetof(Block, size)))
+					{
+						HandleSlot& slot = handleSlot((uint32_t)*(size_t*)&undo->block.data);
+						Block* home = (Block*)((byte*)slot.data.load(std::memory_order_relaxed) - sizeof(size_t) - offsetof(Block, block.data));
+						if (blockSize(home) != blockSize(undo))
+							countResize(&undo->block.data, blockSize(home), slot.tag);
+
+						coreFree(home);
+						slot.data.store(&undo->block.data + sizeof(size_t), std::memory_order_release);
+					}
+
+					if (tail)
+						addBlock(tail);
+
+					return 0;
+				}
+
+				splitBlock(to, size); // split if possible, to maximise memory usage
+				removeBlock(to); // remove this block from the free blocks array
+				to->size &= ~(size_t)4; // a used block in a pool never carries the flag
+
+				memcpy(&to->block.data, &block->block.data, size);
+
+				HandleSlot& slot = handleSlot((uint32_t)*(size_t*)&to->block.data);
+				slot.data.store(&to->block.data + sizeof(size_t), std::memory_order_release);
+				moved += size;
+
+				// a block too small to split off leaves the new home larger, its tag is charged the difference
+				if (blockSize(to) != size)
+					countResize(&to->block.data, size, slot.tag);
+			}
+
+#if defined CHIROBAT_MEMORY_STATS
+			peakBytes = poolBytes - freeBytes > peakBytes ? poolBytes - freeBytes : peakBytes;
+#endif
+
+			// the moved blocks become one used block, freeing it empties the pool
+			if (tail)
+				addBlock(tail);
+			current->block.size = (byte*)end - (byte*)&current->block - offsetof(Block, size);
+			coreFree(&current->block);
+
+			return moved;
+		}
+
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::HandleSlot& TLSF_ALLOCATOR::handleSlot(uint32_t index)
+		{
+			return handleTable[index / handlePageSlots].load(std::memory_order_relaxed)[index % handlePageSlots];
+		}
+
+		TLSF_TEMPLATE
+		bool TLSF_ALLOCATOR::isHandle(Block* block)
+		{
+			// a handle block names its slot, and the slot points back at it
+			size_t index = *(size_t*)&block->block.data;
+
+			return index < handleCount && handleSlot((uint32_t)index).data.load(std::memory_order_relaxed) == &block->block.data + sizeof(size_t);
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::addBlock(Block* block)
 		{
 			MapIndex index; // get the bin for the block
 			getIndex(blockSize(block), &index);
 
 			Block* head = freeBlocks[index.bin]; // get the bin's head
 
-			if (!head) // if there is no head
+			if (!head || realTime) // if there is no head, or order does not matter
 			{
 				freeBlocks[index.bin] = block; // this block is the head
 				block->block.free.prev = nullptr;
-				block->block.free.next = nullptr;
+				block->block.free.next = head;
+
+				// if there was a head, it follows this block
+				if (head)
+					head->block.free.prev = block;
 			}
 			else // there are blocks in this bin
 			{
@@ -217,15 +2212,23 @@ namespace ChiroBat
 			Block* next; // get the next block
 			if (!getNextBlock(block, &next))
 			{
-				next->size |= 2; // tell it that this block is free
+				storeSize(next, next->size | 2); // tell it that this block is free, it may be used and read by its owner
 				next->neighbor = block; // and where it is
 			}
 
 			flMask |= (size_t)1 << index.fl; // flag this layer as being occupied
 			slMasks[index.fl] |= (size_t)1 << index.sl; // flag this bin as being occupied
+
+			// only a whole pool can be this large
+			emptyPools += blockSize(block) == poolBlockSize;
+
+#if defined CHIROBAT_MEMORY_STATS
+			freeBytes += blockSize(block);
+#endif
 		}
 
-		void MemoryManager::removeBlock(Block* block)
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::removeBlock(Block* block)
 		{
 			MapIndex index; // get the bin for the block
 			getIndex(blockSize(block), &index);
@@ -242,27 +2245,33 @@ namespace ChiroBat
 				freeBlocks[index.bin] = block->block.free.next;
 
 			// flag this layer as being empty if need be
-			slMasks[index.fl] &= ~(size_t)(freeBlocks[index.bin] == nullptr) << index.sl;
+			slMasks[index.fl] &= ~((size_t)(freeBlocks[index.bin] == nullptr) << index.sl);
 			// flag this bin as being empty if need be
-			flMask &= ~(size_t)(slMasks[index.fl] == 0) << index.fl;
+			flMask &= ~((size_t)(slMasks[index.fl] == 0) << index.fl);
 
 			// flag this block as being used
 			block->size &= ~(size_t)1;
+			emptyPools -= blockSize(block) == poolBlockSize;
+
+#if defined CHIROBAT_MEMORY_STATS
+			freeBytes -= blockSize(block);
+#endif
 
 			Block* next; // get the next block
 			if (!getNextBlock(block, &next))
-				next->size &= ~(size_t)2; // tell it that this block is being used
+				storeSize(next, next->size & ~(size_t)2); // tell it that this block is being used, it may be used and read by its owner
 		}
 
-		funcRet MemoryManager::splitBlock(Block* block, size_t size)
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::splitBlock(Block* block, size_t size)
 		{
 			// only split if there is room to split
-			if (blockSize(block) - size < sizeof(Block) - sizeof(Block*))
+			if (blockSize(block) - size < minBlockSize + sizeof(size_t))
 				return EXIT_FAILURE;
 			
 			size_t oldSize = blockSize(block); // the current memory to split
 			removeBlock(block); // remove this block from the free blocks array
-			block->size = size; // give it the new size
+			block->size = size | (block->size & 6); // give it the new size, keeping the neighbor and zero flags
 
 			Block* newBlock; // find the splitting block
 
@@ -274,7 +2283,7 @@ namespace ChiroBat
 			
 			// inform it of its new size
 			// TODO if this is the cap, this just corrupted the pool
-			newBlock->size = oldSize - size - sizeof(size_t);
+			newBlock->size = (oldSize - size - sizeof(size_t)) | (block->size & 4);
 
 			// re-introduce the blocks to the free blocks array
 			addBlock(block);
@@ -283,7 +2292,8 @@ namespace ChiroBat
 			return EXIT_SUCCESS;
 		}
 
-		funcRet MemoryManager::getNextBlock(Block* block, Block** next)
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::getNextBlock(Block* block, Block** next)
 		{
 			// grab the next block, given size of the current block
 			*next = (Block*)((byte*)block + blockSize(block) + offsetof(Block, size));
@@ -295,20 +2305,21 @@ namespace ChiroBat
 			return EXIT_SUCCESS;
 		}
 
-		funcRet MemoryManager::getIndex(size_t size, MapIndex* index)
+		TLSF_TEMPLATE
+		funcRet TLSF_ALLOCATOR::getIndex(size_t size, MapIndex* index)
 		{
 			index->fl = findMSB(size); // get the first layer index from the size
 
 			if (index->fl <= packedFLI) // adjustment is needed, packed second layers
 			{
-				// get the second layer index for packed layering
-				index->sl = (byte)(((size ^ ((size_t)1 << index->fl)) >> bitPack) + ((size_t)1 << (index->fl - bitPack)) - 1);
+				// get the second layer index for packed layering, every aligned size below the first layer has its own bin
+				index->sl = (byte)((size >> bitPack) - 1);
 				index->fl = 0; // all packed layers are in first layer 0
 			}
 			else // standard protocol
 			{
 				// the second layer is the SLbitDepth bits before the MSB
-				index->sl = (byte)(size >> (index->fl - SLbitDepth) ^ ((size_t)1 << SLbitDepth));
+				index->sl = (byte)(size >> (index->fl - SLbitDepth) ^ SLgranularity);
 				index->fl -= packedFLI; // offset for the packed 0 layer
 			}
 
@@ -318,29 +2329,52 @@ namespace ChiroBat
 			return EXIT_SUCCESS;
 		}
 
-		MemoryManager::Block* MemoryManager::getBlock(size_t size)
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::Block* TLSF_ALLOCATOR::getBlock(size_t size)
+		{
+			Block* block = findBlock(size);
+
+			// the caller recovers by adding a pool
+			if (!block)
+			{
+				LOG_WARN("[Memory Manager] failed to find a free block, a new pool will be added");
+			}
+
+			return block;
+		}
+
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::Block* TLSF_ALLOCATOR::findBlock(size_t size)
 		{
 			MapIndex index; // get the bin for the block
 			getIndex(size, &index);
 
 			Block* block = freeBlocks[index.bin]; // get the block
 
-			// look for the best-fit block
+			// good-fit only takes a bin whose every block fits, a request above the bin's smallest size moves up a bin
+			if (realTime && binSize(index.bin) < size)
+				block = nullptr;
+
+			// look for the best-fit block, in real-time the head fits or there is no block
 			while (block && blockSize(block) < size)
 				block = block->block.free.next;
 
 			if (!block) // if no block is found
 			{
 				// move up in the second layer
-				size_t newSLMask = slMasks[index.fl] & ~(((size_t)1 << (index.sl + 1)) - 1);
+				size_t newSLMask = slMasks[index.fl] & (~(size_t)1 << index.sl);
 
 				if (!newSLMask) // if there is nothing left in this layer
 				{
 					// move up in the first layer
-					size_t newFLMask = flMask & ~(((size_t)1 << (index.fl + 1)) - 1);
+					size_t newFLMask = flMask & (~(size_t)1 << index.fl);
 
-					// if there is nothing left at all
-					RET_ON_ERR(!newFLMask, nullptr, "[Memory Manager] failed to find a free block, a new pool will be added");
+					// there is nothing left at all, but the head of the request's own bin may still fit
+					if (!newFLMask)
+					{
+						block = realTime ? freeBlocks[index.bin] : nullptr;
+						return block && blockSize(block) >= size ? block : nullptr;
+					}
 
 					// use this new first layer and get its second layer mask
 					index.fl = findLSB(newFLMask);
@@ -354,10 +2388,79 @@ namespace ChiroBat
 			return block;
 		}
 
-		size_t MemoryManager::blockSize(Block* block)
+#if defined CHIROBAT_MEMORY_STATS
+		TLSF_TEMPLATE
+		typename TLSF_ALLOCATOR::StatShard* TLSF_ALLOCATOR::getShard()
+		{
+			// each thread picks a shard once, spreading threads evenly over them
+			static std::atomic<size_t> nextShard(0);
+			static thread_local size_t shard = nextShard++ % statShards;
+
+			return &shards[shard];
+		}
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::usableSize(void* pointer, bool& large)
+		{
+			SlabPage* page = findSlab(pointer);
+			Block* block = (Block*)((byte*)pointer - offsetof(Block, block.data));
+
+			size_t size = page ? page->objectSize : loadSize(block); // read without the lock, the core may set the 0x2 bit under it
+
+			large = !page && size & 4;
+
+			return size & bitPackMask;
+		}
+
+		TLSF_TEMPLATE
+		Tag TLSF_ALLOCATOR::chargedTag(void* pointer, size_t size, Tag tag)
+		{
+			Tag ret = (Tag)((byte*)pointer)[size - 1];
+
+			// Untagged is what a caller that does not know passes, any other tag should agree
+			if (tag != ret && tag != Tag::Untagged)
+			{
+				LOG_WARN("[Memory Manager] an allocation charged to tag %d was released as tag %d", (int)ret, (int)tag);
+			}
+
+			return ret;
+		}
+#endif
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::blockSize(Block* block)
 		{
 			// mask away the bit logic to get the actual size
 			return block->size & bitPackMask;
 		}
+
+		TLSF_TEMPLATE
+		size_t TLSF_ALLOCATOR::loadSize(Block* block)
+		{
+#if defined _MSC_VER && defined _WIN64
+			return (size_t)__iso_volatile_load64((const volatile __int64*)&block->size);
+#elif defined _MSC_VER
+			return (size_t)__iso_volatile_load32((const volatile __int32*)&block->size);
+#else
+			return __atomic_load_n(&block->size, __ATOMIC_RELAXED);
+#endif
+		}
+
+		TLSF_TEMPLATE
+		void TLSF_ALLOCATOR::storeSize(Block* block, size_t size)
+		{
+#if defined _MSC_VER && defined _WIN64
+			__iso_volatile_store64((volatile __int64*)&block->size, (__int64)size);
+#elif defined _MSC_VER
+			__iso_volatile_store32((volatile __int32*)&block->size, (__int32)size);
+#else
+			__atomic_store_n(&block->size, size, __ATOMIC_RELAXED);
+#endif
+		}
+
+		// the tunings available to the engine
+		template class TLSFAllocator<sizeof(void*) == 8 ? 6 : 5, sizeof(void*) * 3, (size_t)1 << 30>; // DefaultAllocator
+		template class TLSFAllocator<sizeof(void*) == 8 ? 6 : 5, sizeof(void*) * 3, (size_t)1 << 24>; // SmallObjectAllocator
+		template class TLSFAllocator<4, 256, (size_t)1 << (sizeof(void*) == 8 ? 40 : 31)>; // LargeBufferAllocator
 	}
 }
\ No newline at end of file
@@ -1,39 +1,147 @@
 #ifndef CHIROBAT_MEMORY
 #define CHIROBAT_MEMORY
 
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
 #include "Types.h"
 #include "Patterns.h"
+#include "Platform.h"
+
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
 
 #define MEMORY ChiroBat::Memory::MemoryManager::instance()
 
 // This allocator is heavily based upon the TLSF memory allocation approach
 // implemented from reading the white papers
 
+// define CHIROBAT_MEMORY_STATS to count allocations per tag and per bin, and track the core's peak use
+// without it the counting compiles to nothing, tags are accepted and ignored
+
 namespace ChiroBat
 {
 	namespace Memory
 	{
-		class MemoryManager : public Patterns::Singleton<MemoryManager>
+		// compile time index of the most significant bit, for sizing the allocator tables
+		constexpr int staticMSB(size_t n)
+		{
+			return n > 1 ? 1 + staticMSB(n >> 1) : (int)n - 1;
+		}
+
+		enum class Tag : byte // the subsystem an allocation is charged to
+		{
+			Untagged, // anything not passing a tag
+			Engine, // engine bookkeeping
+			Frame, // the per-frame arenas
+			Stack, // stack allocator regions
+			Jobs, // job system workers and jobs
+			Entities, // entity component system chunks and tables
+			Streaming, // streamed asset data and requests
+			Count // the number of tags, not a tag
+		};
+
+		struct Handle // a relocatable allocation, resolved to its current address through the heap's handle table
+		{
+			uint32_t index; // the allocation's slot in the handle table
+			uint32_t generation; // the slot's use, bumped when its allocation is freed
+		};
+
+		static constexpr Handle noHandle = { ~(uint32_t)0, 0 }; // never resolves, returned when a handle allocation fails
+
+		// a TLSF allocator with its layer math fixed at compile time
+		// any number of heaps may exist, each with its own pools, policy, and lock, MEMORY is the engine's default heap
+		// the member functions are defined in Memory.cpp, a new tuning needs an explicit instantiation at the bottom of it
+		// SLBits - the power of 2 of the second layer count, at most the power of 2 of the machine's bit size
+		// MinBlock - minimum memory request size for allocation, at least 3 pointers to hold the free list and neighbor
+		// MaxPool - the largest pool size init will accept, sizes the free blocks array
+		template <byte SLBits, size_t MinBlock, size_t MaxPool>
+		class TLSFAllocator
 		{
 		public:
+			TLSFAllocator(); // an uninitialized heap
+			~TLSFAllocator(); // shuts the heap down if it is still initialized
+
+			TLSFAllocator(const TLSFAllocator&) = delete;
+			TLSFAllocator& operator=(const TLSFAllocator&) = delete;
+
 			// initialize the memory manager
 			// poolsize - the poolsize to use, will be rounded up to the max supported from this size
 			// expand - if true, new pools will be allocated as needed
-			funcRet init(size_t poolSize, bool expand);
-			funcRet shutDown(); // shutdown the memory manager
+			// threadCache - if true, the manager is thread safe and small blocks are served from per-thread caches, a block freed on another thread joins that thread's cache, whose excess drains back to this manager
+			// pages - the kind of pages the pools are mapped with
+			funcRet init(size_t poolSize, bool expand, bool threadCache = false, Platform::PageType pages = Platform::PageType::Standard);
+			funcRet shutDown(); // shutdown the memory manager, every block of it is released at once
+			bool initialized(); // whether the manager is between init and shutDown
+
+			// set how many fully free pools stay mapped before further ones are returned to the OS, init resets it to 1
+			// pools - the number of empty pools to keep, the last pool is always kept
+			void setPoolRetention(size_t pools);
+
+			// choose between best-fit and constant time bins, init resets it to best-fit
+			// real-time searches round the request up to the next bin and take its head, frees push to the head of their bin
+			// no bin is walked either way, at the cost of looser packing, the heap may grow where best-fit would have found a block
+			// realTime - true for the constant time bins, false for best-fit
+			void setRealTime(bool realTime);
 
 			template <typename T>
-			int findMSB(T n); // find the index of the most significant bit
+			static int findMSB(T n); // find the index of the most significant bit
 			template <typename T>
-			int findLSB(T n); // find the index of the least significant bit
+			static int findLSB(T n); // find the index of the least significant bit
+
+			// every allocation call takes the tag it is charged to, the counters record it with the allocation and free charges it back there
+			// a free passing a tag other than Untagged that disagrees with the record is logged
+			void* malloc(size_t size, Tag tag = Tag::Untagged); // allocate memory from the pool
+			void* calloc(size_t size, Tag tag = Tag::Untagged); // allocate memory from the pool, and init to 0s
+			void* alignMalloc(size_t size, size_t align, Tag tag = Tag::Untagged); // allocate aligned memory from the pool
+			void* alignCalloc(size_t size, size_t align, Tag tag = Tag::Untagged); // allocate aligned memory from the pool, and init to 0s
+			void* realloc(void* pointer, size_t size, Tag tag = Tag::Untagged); // resize memory in place if possible, moving it otherwise
+			funcRet free(void* pointer, Tag tag = Tag::Untagged); // free memory allocated from the pool
+
+			// allocate many blocks of one size at once, carved back to back out of as few free blocks as possible
+			// count - the number of blocks
+			// size - the size of each block
+			// out - filled with count pointers, back to back within each carved block, freed like any other allocation
+			// returns EXIT_FAILURE if they could not all be allocated, none are then
+			funcRet mallocBatch(size_t count, size_t size, void** out, Tag tag = Tag::Untagged);
+
+			// free many allocations at once, merging neighbors among them before they reach the free blocks array
+			// pointers - the allocations, sorted by address in place, nullptr entries are skipped
+			// count - the number of pointers
+			funcRet freeBatch(void** pointers, size_t count, Tag tag = Tag::Untagged);
+
+			// handle allocations live in the pools like any block, but only through the handle table, so compact may move them
+			// the data is aligned to the bit packing, requests beyond the pools are refused, resolved pointers last until the next compact
+			Handle handleMalloc(size_t size, Tag tag = Tag::Untagged); // allocate relocatable memory from the pool, noHandle on failure
+			funcRet handleFree(Handle handle); // free relocatable memory, charged back to the tag it was allocated with, stale handles are refused
+
+			// get the current address of a handle allocation, without locking
+			// handle - the handle to resolve
+			// returns nullptr if the handle was freed or never allocated
+			void* resolve(Handle handle);
+
+			// slide handle allocations down into the free blocks before them, pool by pool, a step at a time
+			// a pool left holding only handle allocations is emptied into the holes of the other pools, and released past the retention
+			// budget - roughly the bytes to move before returning, at least one block is moved if any can be
+			// returns the bytes moved, 0 once a whole pass over the pools found nothing to move
+			size_t compact(size_t budget);
 
-			void* malloc(size_t size); // allocate memory from the pool
-			void* calloc(size_t size); // allocate memory from the pool, and init to 0s
-			void* alignMalloc(size_t size, size_t align); // allocate aligned memory from the pool
-			void* alignCalloc(size_t size, size_t align); // allocate aligned memory from the pool, and init to 0s
-			funcRet free(void* pointer); // free memory allocated from the pool
-			
 		private:
+			static_assert(SLBits && SLBits <= staticMSB(sizeof(size_t) * 8), "the second layer count must fit in a size_t mask");
+			static_assert(MinBlock >= sizeof(void*) * 3, "the minimum block must hold the free list and the neighbor pointer");
+
+			static constexpr byte SLbitDepth = SLBits; // the power of 2 of the second layer count
+			static constexpr size_t SLgranularity = (size_t)1 << SLBits; // the second layer count
+			static constexpr byte bitPack = 3; // the number of bits in size lost to alignment, used for metadata, 8 bytes on every machine
+			static constexpr byte packedFLI = SLbitDepth + bitPack - 1; // the minimum MSB value needed to exceed a first layer index of 0
+			static constexpr size_t bitPackMask = ~(size_t)0 << bitPack; // helper value for masking out the unused bits in size
+			static constexpr size_t minBlockSize = (MinBlock + ~bitPackMask) & bitPackMask; // minimum memory request size for allocation
+			static constexpr byte FLcount = staticMSB(MaxPool) - packedFLI + 2; // the number of first layers, plus one for page rounding
+			static constexpr size_t maxBlockSize = (((size_t)1 << (staticMSB(MaxPool) + 2)) - 1) & bitPackMask; // largest size the tables can index
+
+			static_assert(staticMSB(MaxPool) > packedFLI, "the maximum pool must exceed the packed first layer");
+
 			struct Block;
 			struct FreeList // packed linked list pointers
 			{
@@ -43,17 +151,18 @@ namespace ChiroBat
 			struct Block // a block of memory, be it free or used
 			{
 				Block* neighbor; // preceeding physical block
-				size_t size; // block size with bitPacking(0x2 = "neighbor is free" 0x1 = "I am free")
+				size_t size; // block size with bitPacking(0x4 = "I am a large mapping" when used, "my data is still zero from the OS" when free in a pool, 0x2 = "neighbor is free" 0x1 = "I am free")
 				union
 				{
 					FreeList free; // doubly linked list of free blocks in a bin
 					byte data; // user data, this is the pointer used by the end user
 				} block; // block data, the memory block (in multiple states)
 			};
-			union Pool // double description of a pool
+			struct Pool // header at the front of each pool's mapping
 			{
-				Block block; // handles shoving the pool into the free block manager
-				Pool* prevPool; // allows cleanup of pools, a singley linked list ending in nullptr
+				Pool* prevPool; // the older pool, the list ends in nullptr
+				Pool* nextPool; // the newer pool, the list ends in nullptr
+				Block block; // handles shoving the pool into the free block manager, its neighbor is never used
 			};
 			struct MapIndex // container for navigating the free blocks map
 			{
@@ -61,24 +170,461 @@ namespace ChiroBat
 				byte fl; // the first layer index
 				byte sl; // the second layer index
 			};
+			struct ThreadCache // per-thread stacks of used objects for the first layer 0 bins
+			{
+				static constexpr byte batchSize = 32; // most objects moved to or from the core at once
+
+				TLSFAllocator* owner; // the manager the cached objects belong to, nullptr if unbound
+				size_t epoch; // the owner's epoch when the cache was bound
+				void* bins[SLgranularity]; // slab objects and block data, singly linked through their first pointer
+				unsigned short counts[SLgranularity]; // number of objects held per bin
+			};
+			struct CacheTable // a thread's caches, one per heap it uses, up to cacheSlots heaps at once
+			{
+				static constexpr byte cacheSlots = 4; // heaps a thread can use before their caches start evicting each other
+
+				ThreadCache caches[cacheSlots]; // the caches, bound to any heap of this tuning
+				byte last; // the slot used most recently
+				byte victim; // the slot the next eviction takes
+
+				~CacheTable(); // drains every cache back to its owner when the thread exits
+			};
+			struct SlabPage // header at the front of a page of equally sized objects, the page is the data of a used block
+			{
+				uintptr_t check; // the page's address xor slabKey, tells slab pages apart from any other memory
+				TLSFAllocator* owner; // the manager the page belongs to
+				SlabPage* prev; // previous page of this size class with free objects
+				SlabPage* next; // next page of this size class with free objects
+				void* freeObjects; // freed objects, singly linked through their first pointer
+				byte* untouched; // the objects past this point have never been handed out
+				unsigned short used; // the number of objects handed out
+				unsigned short objectSize; // the size of every object in the page
+				byte sizeClass; // the page's size class
+			};
+
+			static constexpr size_t slabMaxSize = 256; // largest request served by the slabs
+			static constexpr byte slabClasses = slabMaxSize / 16 + 1; // an 8 byte class, then every multiple of 16
+			static constexpr size_t slabHeaderSize = 64; // the page header padded to a cache line, keeping objects 16 byte aligned
+			static constexpr uintptr_t slabKey = (uintptr_t)0xA5C3F00DA5C3F00DULL; // never a valid address on 64 bit machines
+
+			struct HandleSlot // an entry of the handle table
+			{
+				std::atomic<void*> data; // the allocation's data, nullptr while the slot is free
+				std::atomic<uint32_t> generation; // the slot's use, matched against a handle's
+				union
+				{
+					uint32_t next; // the next free slot while this one is free
+					Tag tag; // the tag the allocation is charged to while it is live
+				};
+			};
+
+			static constexpr size_t handlePageSlots = 4096; // the slots of each mapped page of the handle table
+			static constexpr size_t handlePages = 1024; // the pages the handle table can grow to, fixed so resolve never sees it move
+			static constexpr uint32_t noSlot = ~(uint32_t)0; // ends the free slot list
+
+			static constexpr uint64_t snapshotMagic = 0x4E53504145484243; // "CBHEAPSN"
+			static constexpr uint32_t snapshotVersion = 1; // the snapshot layout this build reads
+
+		public:
+			static constexpr size_t binCount = FLcount * SLgranularity; // the number of bins in the free blocks array
+			static constexpr size_t tagCount = (size_t)Tag::Count; // the number of tags
+
+			struct TagStats // the counters of one tag
+			{
+				size_t liveBytes; // usable bytes allocated and not yet freed
+				size_t allocations; // calls that allocated, a realloc that moves the data counts as a free and an allocation
+				size_t frees; // calls that freed
+			};
+			struct Stats // a snapshot of the manager, the counters are only filled with CHIROBAT_MEMORY_STATS defined
+			{
+				size_t pools; // pools mapped
+				size_t mappedBytes; // bytes mapped from the OS, large mappings are only counted with the counters
+				size_t usedBytes; // pool bytes not in the free blocks array, block headers and cached objects included
+				size_t freeBytes; // pool bytes in the free blocks array
+				size_t largestFreeBlock; // the largest block a pool can hand out without expanding
+				float fragmentation; // 1 - largestFreeBlock / freeBytes, 0 when the free memory is all in one block
+				size_t peakBytes; // counter, the most usedBytes has been
+				size_t liveBytes; // counter, usable bytes allocated and not yet freed over every tag
+				size_t largeAllocations; // counter, allocations beyond the bins
+				TagStats tags[tagCount]; // counter, per tag
+				size_t binAllocations[binCount]; // counter, allocations per bin of their usable size, see binSize
+			};
+
+			// take a snapshot of the manager, locking the core while it is read
+			// stats - the snapshot to fill
+			funcRet getStats(Stats* stats);
+
+			// get the smallest block size a bin holds
+			// bin - the bin index, below binCount
+			static size_t binSize(size_t bin);
+
+			struct BlockInfo // a block as seen by the heap walker
+			{
+				void* data; // the block's data, what malloc handed out if the block is used
+				size_t size; // the block's size, not counting its header
+				size_t pool; // the index of the block's pool, counting from the oldest
+				bool free; // the block is in the free blocks array
+				bool slab; // the block is a slab page, its objects are not walked
+				bool handle; // the block holds a handle allocation, compact may move it
+			};
+			struct PoolUsage // how one pool is used
+			{
+				size_t blocks; // blocks in the pool
+				size_t freeBlocks; // free blocks in the pool
+				size_t usedBytes; // bytes in used blocks, headers included
+				size_t freeBytes; // bytes in free blocks
+				size_t largestFreeBlock; // the largest free block in the pool
+			};
+			struct HeapReport // the results of analyzeHeap
+			{
+				size_t pools; // pools walked
+				size_t blocks; // blocks walked
+				size_t freeBlocks; // free blocks walked
+				size_t slabPages; // used blocks holding slab pages
+				size_t usedBytes; // bytes in used blocks, headers included
+				size_t freeBytes; // bytes in free blocks
+				size_t largestFreeBlock; // the largest free block
+				float fragmentation; // 1 - largestFreeBlock / freeBytes, 0 when the free memory is all in one block
+				size_t unmergedFreeBlocks; // free blocks right after another free block, 0 unless a merge was missed
+				size_t binFreeBlocks[binCount]; // free blocks per bin, see binSize
+			};
+
+			// called by walkHeap for each block
+			// block - the block
+			// user - the pointer given to walkHeap
+			// returns false to stop the walk
+			typedef bool (*HeapVisitor)(const BlockInfo& block, void* user);
+
+			// walk every block of every pool, in address order per pool, locking the core while walking
+			// large mappings are not in any pool and are not walked, cached objects show as used blocks
+			// the visitor must not call into this manager
+			// visitor - called for each block
+			// user - passed to the visitor
+			funcRet walkHeap(HeapVisitor visitor, void* user);
+
+			// walk the heap and summarize its fragmentation
+			// report - the report to fill
+			// pools - filled with the usage of each pool, oldest first, may be nullptr
+			// poolCount - the number of entries pools can hold, pools past it are only in the report
+			funcRet analyzeHeap(HeapReport* report, PoolUsage* pools = nullptr, size_t poolCount = 0);
+
+			// check the pools and the free blocks array agree with each other, logging the first problem found
+			funcRet checkHeap();
+
+			// write the pools and the free blocks array to a file, restore maps them back instead of rebuilding the heap
+			// the pools are written as they are, restore moves the heap's own pointers along wherever the pools land
+			// large allocations are not in the pools and are not written, other threads' cached blocks are written as used
+			// path - the file to write
+			// roots - pointers into the pools the caller needs back, such as the root of a world's state, may be nullptr
+			// rootCount - the length of roots
+			funcRet snapshot(const char* path, void* const* roots = nullptr, size_t rootCount = 0);
+
+			// initialize the memory manager from a snapshot, in place of init
+			// each pool is mapped back at its old address if that is free, anywhere otherwise, and the heap's own pointers are fixed up
+			// pointers stored inside allocations are only still valid if no pool was relocated, handles always are
+			// path - the snapshot to read
+			// threadCache - if true, the manager is thread safe and small blocks are served from per-thread caches
+			// roots - filled with the roots given to snapshot, at their restored addresses, may be nullptr
+			// rootCount - the length of roots, it must match the snapshot's
+			// relocated - set to true if any pool could not be mapped back at its old address, may be nullptr
+			funcRet restore(const char* path, bool threadCache = false, void** roots = nullptr, size_t rootCount = 0, bool* relocated = nullptr);
+
+		private:
+#if defined CHIROBAT_MEMORY_STATS
+			static constexpr size_t tagSize = 1; // every request grows by a byte, the last usable byte of an allocation records its tag
+			static constexpr byte statShards = 8; // threads share this many sets of counters, round robin
+
+			struct alignas(64) StatShard // a set of counters on cache lines of its own, wrapping per shard but summing correctly
+			{
+				std::atomic<size_t> tagLive[tagCount]; // usable bytes allocated less those freed, per tag
+				std::atomic<size_t> tagAllocations[tagCount]; // allocation calls, per tag
+				std::atomic<size_t> tagFrees[tagCount]; // free calls, per tag
+				std::atomic<size_t> binAllocations[binCount]; // allocation calls, per bin of their usable size
+				std::atomic<size_t> largeAllocations; // allocation calls beyond the bins
+			};
+
+			StatShard shards[statShards]; // the sharded counters
+			size_t poolBytes; // block bytes of every pool, guarded like the core
+			size_t freeBytes; // bytes in the free blocks array, guarded like the core
+			size_t peakBytes; // the most the core has had in use, guarded like the core
+			std::atomic<size_t> largeBytes; // bytes in large mappings
+
+			StatShard* getShard(); // get this thread's counters
+
+			// get the bytes an allocation can actually use
+			// pointer - the allocation in question
+			// large - set to whether the allocation is a mapping of its own
+			size_t usableSize(void* pointer, bool& large);
+
+			// get the tag an allocation was charged to, from its last usable byte
+			// pointer - the allocation in question
+			// size - its usable size
+			// tag - the tag the caller released it as, logged if it is another tag than Untagged
+			Tag chargedTag(void* pointer, size_t size, Tag tag);
+#else
+			static constexpr size_t tagSize = 0; // nothing is recorded without the counters
+#endif
+
+			struct HeapAnalysis // the state analyzeHeap carries through the walk
+			{
+				HeapReport* report; // the report being filled
+				PoolUsage* pools; // the pool usage being filled
+				size_t poolCount; // the entries pools can hold
+				size_t lastPool; // the pool of the previous block
+				bool lastFree; // the previous block was free
+			};
+
+			// the visitor analyzeHeap walks with
+			// block - the block
+			// user - the HeapAnalysis
+			static bool analyzeBlock(const BlockInfo& block, void* user);
+
+			// the start of a snapshot, followed by the pool addresses, the roots, the handle slots, and the pool images, oldest pool first
+			struct SnapshotHeader
+			{
+				uint64_t magic; // snapshotMagic
+				uint32_t version; // snapshotVersion
+				uint32_t slBits; // SLBits of the heap, restore must match the tuning
+				size_t minBlock; // MinBlock of the heap
+				size_t maxPool; // MaxPool of the heap
+				size_t maxRequestSize; // the size init was given, restore sizes the pools from it again
+				size_t poolSize; // the bytes of every pool image
+				size_t poolBlockSize; // the bytes of every pool's first block
+				size_t slabPageSize; // the bytes of every slab page
+				uintptr_t heap; // the manager's address, slab pages name it as their owner
+				size_t poolCount; // the pool addresses and images
+				size_t rootCount; // the roots
+				uint32_t handleCount; // the handle slots
+				uint32_t freeHandles; // the first free handle slot
+				size_t retainPools; // fully free pools kept mapped
+				byte expand; // 1 if the heap may add pools
+				byte realTime; // the search mode
+				Platform::PageType pageType; // the kind of pages the pools were mapped with
+				size_t flMask; // the first layer mask
+				size_t slMasks[FLcount]; // the second layer masks
+				uintptr_t freeBlocks[binCount]; // the free lists' heads as they were
+				uintptr_t slabPages[slabClasses]; // the slab classes' pages as they were
+				size_t tagLive[tagCount]; // the counters summed over the shards, 0 unless CHIROBAT_MEMORY_STATS is defined
+				size_t tagAllocations[tagCount]; // as tagLive
+				size_t tagFrees[tagCount]; // as tagLive
+			};
+
+			struct SnapshotSlot // a handle slot in a snapshot
+			{
+				uintptr_t data; // the allocation's data as it was, 0 while the slot is free
+				uint32_t generation; // the slot's use
+				uint32_t next; // the free slot list or the tag, as the slot held it
+			};
+
+			struct Relocation // where a snapshot's pools were restored to
+			{
+				const uintptr_t* bases; // the pools' old addresses, oldest first
+				Pool* oldest; // the restored pools, linked in the same order
+				size_t count; // the pools
+			};
+
+			// read a snapshot's header and map its pools, before anything else can take their old addresses
+			// file - the snapshot, open at its start
+			// threadCache - as given to restore
+			// moved - set to true if a pool could not be mapped at its old address
+			funcRet mapSnapshotPools(FILE* file, bool threadCache, bool* moved);
+
+			// fill the mapped pools and the heap's tables from a mapped snapshot, the caller releases the pools on failure
+			// file - the snapshot
+			// fileSize - the bytes of the snapshot
+			// roots, rootCount - as given to restore
+			funcRet restoreSnapshot(const byte* file, size_t fileSize, void** roots, size_t rootCount);
+
+			// copy a pool image into a restored pool, used blocks as they were and free blocks zero, fixing up the heap's pointers
+			// image - the pool as the snapshot holds it
+			// to - the restored pool
+			// base - the pool's old address
+			// relocation - where the pools went
+			// heap - the snapshot manager's address
+			funcRet restorePool(const byte* image, Pool* to, uintptr_t base, const Relocation& relocation, uintptr_t heap);
+
+			// move a pointer from a snapshot's pools into the restored ones
+			// relocation - where the pools went
+			// pointer - the pointer to move, in place, nullptr stays nullptr
+			// returns EXIT_FAILURE if the pointer was in none of the pools
+			template <class T>
+			funcRet relocate(const Relocation& relocation, T*& pointer);
+
+			// charge an allocation to a tag and a bin
+			// pointer - the allocation, may be nullptr
+			// tag - the tag to charge
+			// returns pointer
+			void* countMalloc(void* pointer, Tag tag);
+
+			// release a charge from the tag recorded with the allocation, before it is freed
+			// pointer - the allocation
+			// tag - the tag the caller believes it was charged to
+			void countFree(void* pointer, Tag tag);
+
+			// move the bytes charged to a tag for an allocation resized or moved in place, it stays one allocation
+			// pointer - the allocation
+			// oldSize - the usable size before it was resized
+			// tag - the tag it was charged to
+			// returns pointer
+			void* countResize(void* pointer, size_t oldSize, Tag tag);
+
+			static_assert(sizeof(SlabPage) <= slabHeaderSize, "the slab page header must fit its padding");
 
 			size_t maxRequestSize; // maximum memory request size for allocation
-			size_t poolSize; // the size of each memory pool
-
-			byte SLgranularity; // the bit size of the machine, used for the second layer granularity
-			byte SLbitDepth; // the power of 2 needed for the bit size
-			byte bitPack; // the number of bits in size lost to alignment, used for metadata
-			byte packedFLI; // the minimum MSB value needed to exceed a first layer index of 0
-			size_t bitPackMask; // helper value for masking out the unused bits in size
-			byte minBlockSize; // minimum memory request size for allocation
+			size_t poolSize; // the size of each memory pool's mapping
+			size_t poolBlockSize; // the size of the block covering a whole pool, at least maxRequestSize
 			byte expand; // 1 - expand, 0 - do not expand
+			Platform::PageType pageType; // the kind of pages the pools are mapped with
+			size_t retainPools; // fully free pools kept mapped before returning them to the OS
+			size_t emptyPools; // pools that are currently one whole free block
+			byte realTime; // 1 - good-fit searches and head insertion in constant time, 0 - best-fit bins kept in size order
 
 			Pool* pool; // the tail of the pool linked list
-			Block** freeBlocks; // the free blocks array
+			Block* freeBlocks[FLcount * SLgranularity]; // the free blocks array
 			size_t flMask; // the first layer mask
-			size_t* slMasks; // the second layer masks
+			size_t slMasks[FLcount]; // the second layer masks
+
+			byte threaded; // 1 - thread caches in front of a locked core, 0 - single threaded
+			std::mutex coreLock; // guards the core while threaded, only taken to refill or drain caches
+			std::atomic<size_t> epoch; // unique over every heap of this tuning and every init, 0 while shut down
+			static std::atomic<size_t> epochs; // the last epoch handed out
+			static thread_local CacheTable localCaches; // this thread's caches
+
+			TLSFAllocator* prevHeap; // the previous live heap of this tuning
+			TLSFAllocator* nextHeap; // the next live heap of this tuning
+			static TLSFAllocator* heaps; // the live heaps of this tuning, for telling a cache's owner still exists
+			static std::mutex registryLock; // guards the live heaps, taken before any core lock
+
+			size_t slabPageSize; // the size and alignment of a slab page, the OS page size, 0 if the pools are too small for slabs
+			SlabPage* slabPages[slabClasses]; // the pages with free objects, per size class
+
+			std::atomic<HandleSlot*> handleTable[handlePages]; // the pages of the handle table, mapped as the slots run out
+			uint32_t handleCount; // the slots handed out so far, guarded like the core
+			uint32_t freeHandles; // the free slot list, guarded like the core
+			size_t compactPool; // the pool compact resumes at, counting from the oldest
+			size_t lapMoved; // the bytes compact moved since it last started from the oldest pool
+
+			// set the manager up for a pool size, without mapping any pool
+			// poolSize, expand, threadCache, pages - as given to init
+			void reset(size_t poolSize, bool expand, bool threadCache, Platform::PageType pages);
+
+			void joinHeaps(); // join the live heaps, once the pools are mapped
+			void unmapPools(); // unmap every pool and the handle table
 
 			funcRet addPool(); // adds a new pool to the allocator
+
+			// unmaps a pool that is one whole free block
+			// empty - the pool to release
+			void releasePool(Pool* empty);
+
+			// allocate a block from the core, without locking
+			// size - the aligned block size needed
+			// zero - set to true if the block's data is zero from the OS, but for its free list and last word
+			Block* coreMalloc(size_t size, bool* zero = nullptr);
+
+			// allocate a block whose data is aligned from the core, splitting the leading gap back into the free blocks array, without locking
+			// size - the aligned block size needed
+			// align - the power of 2 alignment of the data, larger than the natural alignment
+			// zero - set to true if the block's data is zero from the OS, but for its free list and last word
+			Block* coreAlignMalloc(size_t size, size_t align, bool* zero = nullptr);
+
+			// map a block of its own for a request beyond maxRequestSize, its neighbor holds the mapping's start
+			// size - the block size needed
+			// align - the power of 2 alignment of the data
+			Block* largeMalloc(size_t size, size_t align);
+
+			// unmap a block made by largeMalloc
+			// block - the large block to release
+			void largeFree(Block* block);
+
+			// zero the start of a block from the core for calloc
+			// block - the used block
+			// size - the bytes requested
+			// zero - true if the block came back from the core still zero
+			void clearBlock(Block* block, size_t size, bool zero);
+
+			// release a block back to the core, merging with its free neighbors, without locking
+			// block - the used block to release
+			void coreFree(Block* block);
+
+			// grow a used block into its free next neighbor, and/or trim its tail back into the free blocks array, without locking
+			// block - the used block to resize
+			// size - the aligned block size needed
+			funcRet resizeBlock(Block* block, size_t size);
+
+			// allocate a small object from the slabs, or a block from the core past the slab sizes, without locking
+			// size - the slab class size or aligned block size needed
+			void* objectMalloc(size_t size);
+
+			// release a slab object or block data back to the core, without locking
+			// pointer - the object to release
+			void objectFree(void* pointer);
+
+			// get the size class of a slab request
+			// size - the requested size, at most slabMaxSize
+			static byte slabClass(size_t size);
+
+			// get the object size of a slab size class
+			// sizeClass - the size class
+			static size_t slabClassSize(byte sizeClass);
+
+			// find the slab page an object belongs to
+			// pointer - the object in question
+			// returns nullptr if the object is not from a slab
+			SlabPage* findSlab(void* pointer);
+
+			// allocate an object from a size class, carving a new page from the core if none has room, without locking
+			// sizeClass - the size class
+			void* slabMalloc(byte sizeClass);
+
+			// release an object to its page, returning the page to the core once it empties, without locking
+			// page - the object's page
+			// pointer - the object to release
+			void slabFree(SlabPage* page, void* pointer);
+
+			// get a slot of the handle table, it must have been handed out
+			// index - the slot's index
+			HandleSlot& handleSlot(uint32_t index);
+
+			// check whether a used block holds a handle allocation, its data starts with its slot index
+			// block - the used block in question
+			bool isHandle(Block* block);
+
+			// slide the handle allocations of a pool down into the free blocks before them, without locking
+			// current - the pool to compact
+			// budget - the bytes to move before stopping
+			// done - set to whether the pool was walked to its end
+			// returns the bytes moved
+			size_t slidePool(Pool* current, size_t budget, bool& done);
+
+			// move every block of a pool holding only handle allocations into the holes of the other pools, without locking
+			// nothing moves unless all of them fit without expanding or taking a whole empty pool
+			// current - the pool to empty, already slid
+			// returns the bytes moved
+			size_t evacuatePool(Pool* current);
+
+			// get this thread's cache for this heap, binding a slot to it if it has none
+			ThreadCache* getCache();
+
+			// drain a cache into its owner if the owner is still live in the same epoch, then unbind it
+			// cache - the cache to release
+			static void releaseCache(ThreadCache* cache);
+
+			// pop an object from this thread's cache, refilling the bin from the core in a batch if empty
+			// size - the slab class size or aligned block size needed
+			// sl - the first layer 0 bin of the size
+			void* cacheMalloc(size_t size, byte sl);
+
+			// push an object into this thread's cache, draining a batch to the core if the bin is full
+			// pointer - the object to cache
+			// sl - the first layer 0 bin of the object's size
+			void cacheFree(void* pointer, byte sl);
+
+			// return a batch of objects from a cache bin to the core, the core must be locked
+			// cache - the cache to drain
+			// sl - the bin to drain
+			// count - the number of objects to return
+			void drainCache(ThreadCache* cache, byte sl, size_t count);
 							   
 			// adds a freed block to the free blocks array
 			// block - the block to add
@@ -96,49 +642,170 @@ namespace ChiroBat
 			// get the next neihgboring block in memory
 			// block - the block to seek from
 			// next - the block to assign to
-			funcRet getNextBlock(Block* block, Block** next);
+			static funcRet getNextBlock(Block* block, Block** next);
 
 			// get the free blocks index for a size request
 			// size - the block size needed
 			// index - the index info to write to
-			funcRet getIndex(size_t size, MapIndex* index);
+			static funcRet getIndex(size_t size, MapIndex* index);
 
-			// get a block from the free blocks array
+			// get a block from the free blocks array, warning when there is none
 			// size - minimum size to search for
 			Block* getBlock(size_t size);
 
+			// get a block from the free blocks array, quietly
+			// size - minimum size to search for
+			Block* findBlock(size_t size);
+
 			// get the size of a block
 			// block - the block in question
-			size_t blockSize(Block* block);
+			static size_t blockSize(Block* block);
+
+			// read a used block's size word outside the lock, the core may be setting its 0x2 bit under it
+			// block - the block in question
+			static size_t loadSize(Block* block);
+
+			// set a block's size word so a read outside the lock never tears, only with the lock held
+			// block - the block in question
+			// size - the new size word
+			static void storeSize(Block* block, size_t size);
 		};
 
+		template <byte SLBits, size_t MinBlock, size_t MaxPool>
 		template <typename T>
-		int MemoryManager::findMSB(T n)
+		int TLSFAllocator<SLBits, MinBlock, MaxPool>::findMSB(T n)
 		{
 			if (!n) // 0 check case
 				return -1;
 
-			constexpr int mid = (sizeof(T) << 2) - 1; // middle of the binary tree
-			constexpr int index = sizeof(T) - (sizeof(T) == 4) - ((sizeof(T) == 8) << 2); // stepping index
-			constexpr int steps[6] = { 1, 2, 4, 8, 16, 32 }; // steps for the tree search
-			int ret = mid; // start in the middle
-			int i = index; // step from the index
-			T test;
+			unsigned long long bits = (unsigned long long)n; // widen so one bit-scan covers every T
 
-			while ((test = n >> ret) - 1) // while the MSB has not been found
+#if defined _MSC_VER && defined _WIN64
+			unsigned long ret;
+			_BitScanReverse64(&ret, bits);
+			return (int)ret;
+#elif defined _MSC_VER
+			unsigned long ret; // no 64 bit scan, check the high half first
+			if (bits >> 32)
 			{
-				ret -= steps[i] - (steps[i + 1] & (!test - 1)); // step
-				i -= !!i; // decrement the step
+				_BitScanReverse(&ret, (unsigned long)(bits >> 32));
+				return (int)ret + 32;
 			}
-
-			return ret;
+			_BitScanReverse(&ret, (unsigned long)bits);
+			return (int)ret;
+#else
+			return 63 - __builtin_clzll(bits);
+#endif
 		}
 
+		template <byte SLBits, size_t MinBlock, size_t MaxPool>
 		template <typename T>
-		int MemoryManager::findLSB(T n)
+		int TLSFAllocator<SLBits, MinBlock, MaxPool>::findLSB(T n)
+		{
+			if (!n) // 0 check case
+				return -1;
+
+			unsigned long long bits = (unsigned long long)n; // widen so one bit-scan covers every T
+
+#if defined _MSC_VER && defined _WIN64
+			unsigned long ret;
+			_BitScanForward64(&ret, bits);
+			return (int)ret;
+#elif defined _MSC_VER
+			unsigned long ret; // no 64 bit scan, check the low half first
+			if ((unsigned long)bits)
+			{
+				_BitScanForward(&ret, (unsigned long)bits);
+				return (int)ret;
+			}
+			_BitScanForward(&ret, (unsigned long)(bits >> 32));
+			return (int)ret + 32;
+#else
+			return __builtin_ctzll(bits);
+#endif
+		}
+
+		// the counting is inline so it disappears entirely without CHIROBAT_MEMORY_STATS
+
+		template <byte SLBits, size_t MinBlock, size_t MaxPool>
+		inline void* TLSFAllocator<SLBits, MinBlock, MaxPool>::countMalloc(void* pointer, Tag tag)
+		{
+#if defined CHIROBAT_MEMORY_STATS
+			if (!pointer)
+				return pointer;
+
+			bool large;
+			size_t size = usableSize(pointer, large);
+			StatShard* shard = getShard();
+
+			((byte*)pointer)[size - 1] = (byte)tag; // the request grew by tagSize, the byte is past the caller's data
+
+			shard->tagLive[(size_t)tag].fetch_add(size, std::memory_order_relaxed);
+			shard->tagAllocations[(size_t)tag].fetch_add(1, std::memory_order_relaxed);
+
+			if (large) // large mappings are not from any bin
+				shard->largeAllocations.fetch_add(1, std::memory_order_relaxed);
+			else
+			{
+				MapIndex index;
+				getIndex(size, &index);
+				shard->binAllocations[index.bin].fetch_add(1, std::memory_order_relaxed);
+			}
+#else
+			(void)tag;
+#endif
+			return pointer;
+		}
+
+		template <byte SLBits, size_t MinBlock, size_t MaxPool>
+		inline void TLSFAllocator<SLBits, MinBlock, MaxPool>::countFree(void* pointer, Tag tag)
 		{
-			return findMSB(n & (~n + 1)); // mask out the LSB and use MSB to find it
+#if defined CHIROBAT_MEMORY_STATS
+			bool large;
+			size_t size = usableSize(pointer, large);
+			StatShard* shard = getShard();
+
+			tag = chargedTag(pointer, size, tag);
+
+			// the shard may go below 0, the sum over every shard does not
+			shard->tagLive[(size_t)tag].fetch_sub(size, std::memory_order_relaxed);
+			shard->tagFrees[(size_t)tag].fetch_add(1, std::memory_order_relaxed);
+#else
+			(void)pointer;
+			(void)tag;
+#endif
 		}
+
+		template <byte SLBits, size_t MinBlock, size_t MaxPool>
+		inline void* TLSFAllocator<SLBits, MinBlock, MaxPool>::countResize(void* pointer, size_t oldSize, Tag tag)
+		{
+#if defined CHIROBAT_MEMORY_STATS
+			bool large;
+			size_t size = usableSize(pointer, large);
+			StatShard* shard = getShard();
+
+			((byte*)pointer)[size - 1] = (byte)tag; // the record moves to the new last byte
+
+			// only the difference is charged, the calls were counted when the allocation was made
+			shard->tagLive[(size_t)tag].fetch_add(size - oldSize, std::memory_order_relaxed);
+#else
+			(void)oldSize;
+			(void)tag;
+#endif
+			return pointer;
+		}
+
+		// the general purpose tuning, a second layer per machine bit
+		typedef TLSFAllocator<sizeof(void*) == 8 ? 6 : 5, sizeof(void*) * 3, (size_t)1 << 30> DefaultAllocator;
+		// fine bins for many small objects in modest pools
+		typedef TLSFAllocator<sizeof(void*) == 8 ? 6 : 5, sizeof(void*) * 3, (size_t)1 << 24> SmallObjectAllocator;
+		// coarse bins and a large block floor for big buffers
+		typedef TLSFAllocator<4, 256, (size_t)1 << (sizeof(void*) == 8 ? 40 : 31)> LargeBufferAllocator;
+
+		// the engine's global allocator
+		class MemoryManager : public DefaultAllocator, public Patterns::Singleton<MemoryManager>
+		{
+		};
 	}
 }
 
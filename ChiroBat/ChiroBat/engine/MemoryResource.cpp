@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include "MemoryResource.h"
+
+namespace ChiroBat
+{
+	namespace Memory
+	{
+#if defined CHIROBAT_MEMORY_PMR
+		void* MemoryResource::do_allocate(size_t bytes, size_t alignment)
+		{
+			void* ret = heap->alignMalloc(bytes, alignment, tag);
+			if (!ret) // resources report failure by throwing
+				throw std::bad_alloc();
+
+			return ret;
+		}
+
+		void MemoryResource::do_deallocate(void* pointer, size_t, size_t)
+		{
+			heap->free(pointer, tag);
+		}
+
+		bool MemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+		{
+			// any resource on the same heap and tag can free this one's memory
+			const MemoryResource* resource = dynamic_cast<const MemoryResource*>(&other);
+			return resource && resource->heap == heap && resource->tag == tag;
+		}
+#endif
+
+#if defined CHIROBAT_ROUTE_NEW
+		// new may run before the manager is initialized and delete after it shuts down, so where the memory came from is kept in its address
+		// manager memory sits on a multiple of twice its alignment and system memory halfway between, delete never reads from a heap that is gone
+		// what the heap handed out is kept in the word just ahead of the returned memory
+
+		static constexpr size_t newAlignment = 16; // the alignment every plain new must meet
+
+		// the first address at least a word past base that sits offset past a multiple of twice the alignment
+		// base - what the heap handed out
+		// align - the alignment, at least newAlignment
+		// offset - 0 for manager memory, align for system memory
+		static byte* placeNew(byte* base, size_t align, size_t offset)
+		{
+			uintptr_t step = 2 * align;
+			return (byte*)((((uintptr_t)base + sizeof(void*) - offset + step - 1) & ~(step - 1)) + offset);
+		}
+
+		// allocate for new, from the memory manager if it is running
+		// size - the bytes requested
+		// align - the alignment, at least newAlignment
+		static void* routedNew(size_t size, size_t align)
+		{
+			// room for twice the alignment ahead of the memory, from the system the heap's pointer may sit on any boundary so a word more
+			if (size > ~(size_t)0 - 2 * align - sizeof(void*))
+				return nullptr;
+
+			bool fromManager = MEMORY.initialized();
+			byte* base;
+
+			if (!fromManager)
+				base = (byte*)::malloc(size + 2 * align + sizeof(void*));
+			else if (align == newAlignment) // plain malloc keeps to the thread caches, its blocks are pointer aligned
+				base = (byte*)MEMORY.malloc(size + 2 * align);
+			else
+				base = (byte*)MEMORY.alignMalloc(size + 2 * align, align);
+
+			if (!base)
+				return nullptr;
+
+			byte* ret = placeNew(base, align, fromManager ? 0 : align);
+			((void**)ret)[-1] = base;
+
+			return ret;
+		}
+
+		// release memory from routedNew
+		// pointer - the memory returned by routedNew, may be nullptr
+		// align - the alignment it was allocated with
+		static void routedDelete(void* pointer, size_t align)
+		{
+			if (!pointer)
+				return;
+
+			if ((uintptr_t)pointer & align)
+				::free(((void**)pointer)[-1]);
+			else if (MEMORY.initialized()) // once the manager shuts down its memory is already gone, as in static destructors run after it
+				MEMORY.free(((void**)pointer)[-1]);
+		}
+
+#if defined __cpp_aligned_new
+		// the alignment for an over-aligned new or delete
+		// align - the alignment of the type
+		static size_t routedAlignment(std::align_val_t align)
+		{
+			return (size_t)align > newAlignment ? (size_t)align : newAlignment;
+		}
+#endif
+#endif
+	}
+}
+
+#if defined CHIROBAT_ROUTE_NEW
+// the replacements must live in the global namespace
+
+void* operator new(size_t size)
+{
+	void* ret = ChiroBat::Memory::routedNew(size, ChiroBat::Memory::newAlignment);
+	if (!ret)
+		throw std::bad_alloc();
+
+	return ret;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return ChiroBat::Memory::routedNew(size, ChiroBat::Memory::newAlignment);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return ChiroBat::Memory::routedNew(size, ChiroBat::Memory::newAlignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::newAlignment);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::newAlignment);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::newAlignment);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::newAlignment);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::newAlignment);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::newAlignment);
+}
+
+#if defined __cpp_aligned_new
+// over-aligned types, C++17 and up
+
+void* operator new(size_t size, std::align_val_t align)
+{
+	void* ret = ChiroBat::Memory::routedNew(size, ChiroBat::Memory::routedAlignment(align));
+	if (!ret)
+		throw std::bad_alloc();
+
+	return ret;
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+	return operator new(size, align);
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	return ChiroBat::Memory::routedNew(size, ChiroBat::Memory::routedAlignment(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, align, tag);
+}
+
+void operator delete(void* pointer, std::align_val_t align) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::routedAlignment(align));
+}
+
+void operator delete[](void* pointer, std::align_val_t align) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::routedAlignment(align));
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t align) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::routedAlignment(align));
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t align) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::routedAlignment(align));
+}
+
+void operator delete(void* pointer, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::routedAlignment(align));
+}
+
+void operator delete[](void* pointer, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	ChiroBat::Memory::routedDelete(pointer, ChiroBat::Memory::routedAlignment(align));
+}
+#endif
+#endif
@@ -0,0 +1,97 @@
+#ifndef CHIROBAT_MEMORYRESOURCE
+#define CHIROBAT_MEMORYRESOURCE
+
+#include <new>
+#include "Types.h"
+#include "Memory.h"
+
+// adapters putting standard containers on the memory manager
+// Allocator - the classic allocator template, for any standard
+// MemoryResource - a std::pmr::memory_resource, only where the library has <memory_resource>
+// define CHIROBAT_ROUTE_NEW to send the global operator new and delete to the memory manager while it is initialized
+// routed memory from the manager deleted after it shuts down is ignored, it went with the pools, and threads may only new once it is initialized with thread caches
+
+#if defined __has_include
+#if __has_include(<memory_resource>) && ((defined _MSVC_LANG && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L)
+#include <memory_resource>
+#define CHIROBAT_MEMORY_PMR
+#endif
+#endif
+
+namespace ChiroBat
+{
+	namespace Memory
+	{
+		// a standard allocator over the memory manager
+		// T - the type allocated
+		// AllocTag - the tag the memory is charged to
+		template <class T, Tag AllocTag = Tag::Untagged>
+		class Allocator
+		{
+		public:
+			typedef T value_type;
+
+			template <class U>
+			struct rebind // the tag is not a type, the standard cannot rebind without this
+			{
+				typedef Allocator<U, AllocTag> other;
+			};
+
+			Allocator() noexcept {}
+			template <class U>
+			Allocator(const Allocator<U, AllocTag>&) noexcept {}
+
+			T* allocate(size_t count)
+			{
+				// guard the multiply, then let alignMalloc pick the aligned path only when T needs it
+				if (count > ~(size_t)0 / sizeof(T))
+					throw std::bad_alloc();
+
+				T* ret = (T*)MEMORY.alignMalloc(count * sizeof(T), alignof(T), AllocTag);
+				if (!ret)
+					throw std::bad_alloc();
+
+				return ret;
+			}
+
+			void deallocate(T* pointer, size_t)
+			{
+				MEMORY.free(pointer, AllocTag);
+			}
+		};
+
+		// every allocator with the same tag can free the others' memory
+		template <class T, class U, Tag AllocTag>
+		bool operator==(const Allocator<T, AllocTag>&, const Allocator<U, AllocTag>&) noexcept
+		{
+			return true;
+		}
+
+		template <class T, class U, Tag AllocTag>
+		bool operator!=(const Allocator<T, AllocTag>&, const Allocator<U, AllocTag>&) noexcept
+		{
+			return false;
+		}
+
+#if defined CHIROBAT_MEMORY_PMR
+		// a polymorphic memory resource over a heap, the memory manager unless told otherwise
+		class MemoryResource : public std::pmr::memory_resource
+		{
+		public:
+			// tag - the tag the memory is charged to
+			// heap - the heap to allocate from, it must outlive the resource
+			explicit MemoryResource(Tag tag = Tag::Untagged, DefaultAllocator* heap = &MEMORY) noexcept : tag(tag), heap(heap) {}
+
+		private:
+			Tag tag; // the tag the memory is charged to
+			DefaultAllocator* heap; // the heap the memory comes from
+
+			void* do_allocate(size_t bytes, size_t alignment) override;
+			void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+		};
+#endif
+	}
+}
+
+#endif
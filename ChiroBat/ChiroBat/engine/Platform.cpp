@@ -0,0 +1,196 @@
+#if defined _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include "Platform.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Platform
+	{
+		size_t pageSize()
+		{
+#if defined _WIN32
+			static const size_t size = []()
+			{
+				SYSTEM_INFO info;
+				GetSystemInfo(&info);
+				return (size_t)info.dwPageSize;
+			}();
+#else
+			static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+
+			return size;
+		}
+
+		size_t hugePageSize()
+		{
+#if defined _WIN32
+			static const size_t size = GetLargePageMinimum();
+#else
+			static const size_t size = []()
+			{
+				size_t ret = 0;
+
+				// the kernel reports the default huge page size in kB
+				FILE* info = fopen("/proc/meminfo", "r");
+				if (!info)
+					return ret;
+
+				char line[128];
+				while (fgets(line, sizeof(line), info))
+					if (sscanf(line, "Hugepagesize: %zu kB", &ret) == 1)
+						break;
+
+				fclose(info);
+				return ret << 10;
+			}();
+#endif
+
+			return size;
+		}
+
+		size_t mappingSize(size_t size, PageType type)
+		{
+			// huge pages only help if the whole mapping can be made of them
+			size_t granularity = type != PageType::Standard && hugePageSize() ? hugePageSize() : pageSize();
+
+			return (size + granularity - 1) & ~(granularity - 1);
+		}
+
+		void* mapMemory(size_t size, PageType type, void* hint)
+		{
+#if defined _WIN32
+			void* ret = nullptr;
+
+			// large pages need the lock pages privilege, fall back quietly to standard pages
+			if (type == PageType::ExplicitHuge && hugePageSize())
+				ret = VirtualAlloc(hint, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+			// a hinted address that is taken fails outright, try again anywhere
+			if (!ret && hint)
+				ret = VirtualAlloc(hint, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+			if (!ret)
+				ret = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+			RET_ON_ERR(!ret, nullptr, "[Platform] failed to map %zu bytes", size);
+#else
+			void* ret = MAP_FAILED;
+
+#if defined MAP_HUGETLB
+			// explicit huge pages come from the reserved pool, which may be empty
+			if (type == PageType::ExplicitHuge && hugePageSize())
+			{
+				ret = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+				if (ret == MAP_FAILED)
+				{
+					LOG_ERR("[Platform] no huge pages available for %zu bytes, using standard pages", size);
+				}
+			}
+#endif
+
+			if (ret == MAP_FAILED)
+				ret = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // without MAP_FIXED the hint never replaces a mapping
+
+			RET_ON_ERR(ret == MAP_FAILED, nullptr, "[Platform] failed to map %zu bytes", size);
+
+#if defined MADV_HUGEPAGE
+			// a hint only, the kernel may still use standard pages
+			if (type == PageType::TransparentHuge)
+				madvise(ret, size, MADV_HUGEPAGE);
+#endif
+#endif
+
+			return ret;
+		}
+
+		funcRet unmapMemory(void* address, size_t size)
+		{
+#if defined _WIN32
+			RET_ON_ERR(!VirtualFree(address, 0, MEM_RELEASE), EXIT_FAILURE, "[Platform] failed to unmap %zu bytes at %p", size, address);
+#else
+			RET_ON_ERR(munmap(address, size), EXIT_FAILURE, "[Platform] failed to unmap %zu bytes at %p", size, address);
+#endif
+
+			return EXIT_SUCCESS;
+		}
+
+		const void* mapFile(const char* path, size_t* size)
+		{
+#if defined _WIN32
+			HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			RET_ON_ERR(file == INVALID_HANDLE_VALUE, nullptr, "[Platform] failed to open %s", path);
+
+			LARGE_INTEGER length = {};
+			HANDLE mapping = nullptr;
+			void* ret = nullptr;
+
+			if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+				mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+			// the view keeps the file and the mapping open on its own
+			if (mapping)
+			{
+				ret = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+
+			RET_ON_ERR(!ret, nullptr, "[Platform] failed to map %s", path);
+			*size = (size_t)length.QuadPart;
+#else
+			int file = open(path, O_RDONLY);
+			RET_ON_ERR(file < 0, nullptr, "[Platform] failed to open %s", path);
+
+			struct stat info;
+			void* ret = MAP_FAILED;
+
+			if (!fstat(file, &info) && info.st_size > 0)
+				ret = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+			// the mapping keeps the file open on its own
+			close(file);
+
+			RET_ON_ERR(ret == MAP_FAILED, nullptr, "[Platform] failed to map %s", path);
+			*size = (size_t)info.st_size;
+#endif
+
+			return ret;
+		}
+
+		funcRet unmapFile(const void* address, size_t size)
+		{
+#if defined _WIN32
+			RET_ON_ERR(!UnmapViewOfFile(address), EXIT_FAILURE, "[Platform] failed to unmap the %zu byte file at %p", size, address);
+#else
+			RET_ON_ERR(munmap((void*)address, size), EXIT_FAILURE, "[Platform] failed to unmap the %zu byte file at %p", size, address);
+#endif
+
+			return EXIT_SUCCESS;
+		}
+
+		void prefetchFile(const void* address, size_t size)
+		{
+			if (!size)
+				return;
+
+#if defined _WIN32
+			WIN32_MEMORY_RANGE_ENTRY range = { (void*)address, size };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+			// the range has to start on a page
+			uintptr_t start = (uintptr_t)address & ~(uintptr_t)(pageSize() - 1);
+			madvise((void*)start, (uintptr_t)address + size - start, MADV_WILLNEED);
+#endif
+		}
+	}
+}
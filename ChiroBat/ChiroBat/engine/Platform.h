@@ -0,0 +1,56 @@
+#ifndef CHIROBAT_PLATFORM
+#define CHIROBAT_PLATFORM
+
+#include "Types.h"
+
+// thin wrappers over the OS services the engine needs, one implementation per OS in Platform.cpp
+
+namespace ChiroBat
+{
+	namespace Platform
+	{
+		enum class PageType : byte // how mapped memory is backed
+		{
+			Standard, // regular pages
+			TransparentHuge, // regular pages, hinted to the OS to back with huge pages where it can
+			ExplicitHuge // reserved huge pages, falls back to standard pages if none are available
+		};
+
+		size_t pageSize(); // the size of a standard page
+		size_t hugePageSize(); // the size of a huge page, 0 if the system has none
+
+		// get the size a mapping must have to hold a request
+		// size - the bytes requested
+		// type - the kind of pages that will back the mapping
+		size_t mappingSize(size_t size, PageType type);
+
+		// map zeroed memory straight from the OS
+		// size - the number of bytes, as given by mappingSize
+		// type - the kind of pages to back the memory with
+		// hint - an address to map at if it is free, the OS picks one otherwise
+		void* mapMemory(size_t size, PageType type, void* hint = nullptr);
+
+		// return mapped memory to the OS
+		// address - the address given by mapMemory
+		// size - the size given to mapMemory
+		funcRet unmapMemory(void* address, size_t size);
+
+		// map a file read-only, its pages are read in as they are touched
+		// path - the file to map
+		// size - set to the file's size
+		// returns the mapping, nullptr on failure or for an empty file
+		const void* mapFile(const char* path, size_t* size);
+
+		// return a file mapping to the OS
+		// address - the address given by mapFile
+		// size - the size given by mapFile
+		funcRet unmapFile(const void* address, size_t size);
+
+		// ask the OS to start reading part of a mapped file, a hint only
+		// address - the start of the range
+		// size - the bytes in the range
+		void prefetchFile(const void* address, size_t size);
+	}
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include "Profiler.h"
+#include "Platform.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Profiler
+	{
+		thread_local ThreadRing* localRing = nullptr;
+
+		static std::atomic<ThreadRing*> rings(nullptr); // every ring, newest first
+		static std::atomic<uint32_t> threadCount(0); // the thread ids handed out
+		static std::mutex ringLock; // held by the dump and by a thread taking over a retired ring
+		static thread_local bool threadExited = false; // this thread's ring was retired, later scopes go unrecorded
+
+		// retires this thread's ring when the thread exits
+		struct RingOwner
+		{
+			ThreadRing* ring;
+
+			~RingOwner()
+			{
+				threadExited = true;
+				localRing = nullptr;
+				ring->retired.store(true, std::memory_order_release);
+			}
+		};
+
+		// a tick and the real time it was read at, ticks are converted against it at dump
+		struct Origin
+		{
+			uint64_t ticks;
+			std::chrono::steady_clock::time_point time;
+		};
+
+		static const Origin& origin()
+		{
+			static const Origin origin = { ticks(), std::chrono::steady_clock::now() };
+			return origin;
+		}
+
+		ThreadRing* attachThread()
+		{
+			// scopes closed by other thread local destructors after the ring was retired
+			if (threadExited)
+				return nullptr;
+
+			// fix the origin before the thread's first scope closes
+			origin();
+
+			ThreadRing* ring = nullptr;
+			{
+				// take over the ring of an exited thread once everything it recorded is dumped
+				std::lock_guard<std::mutex> lock(ringLock);
+
+				for (ThreadRing* retired = rings.load(std::memory_order_acquire); retired; retired = retired->next)
+				{
+					if (retired->retired.load(std::memory_order_acquire) && retired->dumped == retired->head.load(std::memory_order_relaxed))
+					{
+						ring = retired;
+						ring->head.store(0, std::memory_order_relaxed);
+						ring->dumped = 0;
+						ring->thread = threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+						ring->retired.store(false, std::memory_order_relaxed);
+						break;
+					}
+				}
+			}
+
+			if (!ring)
+			{
+				// the rings come straight from the OS, the memory manager is among the things being timed
+				size_t size = Platform::mappingSize(sizeof(ThreadRing), Platform::PageType::Standard);
+				ring = (ThreadRing*)Platform::mapMemory(size, Platform::PageType::Standard);
+				RET_ON_ERR(!ring, nullptr, "[Profiler] failed to map a ring of size %zu", size);
+
+				// mapped memory is zeroed, only the id and link need setting
+				ring->thread = threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+				ring->next = rings.load(std::memory_order_relaxed);
+				while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed));
+			}
+
+			static thread_local RingOwner owner = { ring };
+			localRing = ring;
+
+			return ring;
+		}
+
+		// write a string as a JSON string
+		// file - the file to write to
+		// string - the string to write
+		static void writeString(FILE* file, const char* string)
+		{
+			fputc('"', file);
+
+			for (; *string; ++string)
+			{
+				if (*string == '"' || *string == '\\')
+					fputc('\\', file);
+				fputc(*string, file);
+			}
+
+			fputc('"', file);
+		}
+
+		funcRet dumpTrace(const char* path)
+		{
+			// each dump moves the rings' dumped marks
+			std::lock_guard<std::mutex> lock(ringLock);
+
+			FILE* file = nullptr;
+#if defined _WIN32
+			fopen_s(&file, path, "w");
+#else
+			file = fopen(path, "w");
+#endif
+			RET_ON_ERR(!file, EXIT_FAILURE, "[Profiler] failed to open %s for the trace", path);
+
+			// the tick rate comes from how far the ticks and the clock have both moved since the origin
+			const Origin& start = origin();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start.time).count();
+			uint64_t elapsed = ticks() - start.ticks;
+			double ticksPerMicrosecond = seconds > 0.0 && elapsed ? elapsed / (seconds * 1e6) : 1.0;
+
+			fputs("{\"traceEvents\":[", file);
+
+			bool first = true;
+			for (ThreadRing* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+			{
+				size_t head = ring->head.load(std::memory_order_acquire);
+
+				// anything older than a ring's length has been overwritten
+				size_t from = head - ring->dumped > ringSize ? head - ringSize : ring->dumped;
+
+				for (size_t i = from; i < head; ++i)
+				{
+					const Event& event = ring->events[i & (ringSize - 1)];
+
+					fputs(first ? "\n" : ",\n", file);
+					first = false;
+
+					fputs("{\"name\":", file);
+					writeString(file, event.name);
+					fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ring->thread,
+						(double)(int64_t)(event.begin - start.ticks) / ticksPerMicrosecond, (double)(event.end - event.begin) / ticksPerMicrosecond);
+				}
+
+				ring->dumped = head;
+			}
+
+			fputs("\n],\"displayTimeUnit\":\"ns\"}\n", file);
+
+			funcRet ret = ferror(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+			fclose(file);
+			RET_ON_ERR(ret, EXIT_FAILURE, "[Profiler] failed to write the trace to %s", path);
+
+			return EXIT_SUCCESS;
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef CHIROBAT_PROFILER
+#define CHIROBAT_PROFILER
+
+#include <atomic>
+#include "Types.h"
+
+#if defined _MSC_VER
+#include <intrin.h>
+#elif defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// scoped timing for hot paths, compiled in with CHIROBAT_PROFILE, see PROFILE_SCOPE in Debug.h
+// every thread writes the scopes it closes into its own ring buffer, no locks or shared writes
+// a thread that exits retires its ring, a new thread takes it over once the dump has written it, so restarted threads reuse rings
+// a ring keeps the newest ringSize scopes of its thread, older ones are overwritten
+// dumpTrace writes what was recorded as Chrome trace JSON, load it in chrome://tracing or Perfetto
+
+namespace ChiroBat
+{
+	namespace Profiler
+	{
+		static constexpr size_t ringSize = (size_t)1 << 14; // the scopes each thread keeps, a power of 2
+
+		struct Event // a closed scope
+		{
+			const char* name; // the scope's name, it must outlive the profiler
+			uint64_t begin; // the ticks the scope opened at
+			uint64_t end; // the ticks the scope closed at
+		};
+
+		struct ThreadRing // the scopes of one thread, created on its first scope, a later thread takes it over once its thread exits and it is dumped
+		{
+			Event events[ringSize]; // the newest scopes of the thread
+			std::atomic<size_t> head; // the scopes ever recorded, the next one goes in events[head % ringSize]
+			size_t dumped; // the scopes already dumped, only touched under the ring lock
+			uint32_t thread; // the id of the thread in the trace
+			std::atomic<bool> retired; // the thread exited, the ring is free once every scope in it is dumped
+			ThreadRing* next; // the next ring in the list of every ring
+		};
+
+		extern thread_local ThreadRing* localRing; // this thread's ring, nullptr until its first scope and once the thread exits
+
+		ThreadRing* attachThread(); // give this thread a ring, a retired one that was dumped or a new one
+
+		// the raw time, as cheap to read as the hardware allows, converted to real time at dump
+		inline uint64_t ticks()
+		{
+#if defined _MSC_VER || defined __x86_64__ || defined __i386__
+			return __rdtsc();
+#else
+			return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+		}
+
+		// record a closed scope on this thread
+		// name - the scope's name
+		// begin - the ticks it opened at
+		// end - the ticks it closed at
+		inline void record(const char* name, uint64_t begin, uint64_t end)
+		{
+			ThreadRing* ring = localRing;
+			if (!ring)
+			{
+				ring = attachThread();
+				if (!ring)
+					return;
+			}
+
+			size_t head = ring->head.load(std::memory_order_relaxed);
+
+			Event& event = ring->events[head & (ringSize - 1)];
+			event.name = name;
+			event.begin = begin;
+			event.end = end;
+
+			ring->head.store(head + 1, std::memory_order_release);
+		}
+
+		// times the scope it lives in
+		class Scope
+		{
+		public:
+			explicit Scope(const char* name) : name(name), begin(ticks()) {}
+			~Scope() { record(name, begin, ticks()); }
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			const char* name; // the scope's name
+			uint64_t begin; // the ticks the scope opened at
+		};
+
+		// write every scope recorded since the last dump as Chrome trace JSON
+		// threads that keep recording during the dump may overwrite the oldest scopes being written, dump between frames or at shut down
+		// path - the file to write
+		funcRet dumpTrace(const char* path);
+	}
+}
+
+#endif
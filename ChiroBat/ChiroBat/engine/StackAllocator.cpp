@@ -0,0 +1,122 @@
+#include "StackAllocator.h"
+#include "Memory.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Memory
+	{
+		StackAllocator::StackAllocator()
+			: region(nullptr), size(0), bottom(0), top(0)
+		{
+		}
+
+		funcRet StackAllocator::init(size_t size)
+		{
+			// prevent over-initialization
+			RET_ON_ERR(region, EXIT_FAILURE, "[Stack Allocator] re-initialization of the stack was attempted");
+
+			// keep the ends aligned at the start and end of the region
+			size = (size + alignment - 1) & ~(alignment - 1);
+
+			region = (byte*)MEMORY.alignMalloc(size, alignment, Tag::Stack);
+			RET_ON_ERR(!region, EXIT_FAILURE, "[Stack Allocator] failed to allocate a region of size %zu", size);
+
+			this->size = size;
+			bottom = 0;
+			top = size;
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet StackAllocator::shutDown()
+		{
+			// there is nothing to shut down if this is true
+			RET_ON_ERR(!region, EXIT_FAILURE, "[Stack Allocator] shutdown of the non-initialized stack was attempted");
+
+			MEMORY.free(region, Tag::Stack);
+
+			region = nullptr;
+			size = bottom = top = 0;
+
+			return EXIT_SUCCESS;
+		}
+
+		void* StackAllocator::malloc(size_t size, End end)
+		{
+			return alignMalloc(size, alignment, end);
+		}
+
+		void* StackAllocator::alignMalloc(size_t size, size_t align, End end)
+		{
+			// the alignment must be a power of 2
+			RET_ON_ERR(!align || align & (align - 1), nullptr, "[Stack Allocator] aligned malloc alignment of %zu is not a power of 2", align);
+
+			if (align < alignment)
+				align = alignment;
+
+			// work in addresses so alignments beyond the region's own are honored
+			uintptr_t start = (uintptr_t)region;
+
+			if (end == End::Bottom)
+			{
+				uintptr_t ret = (start + bottom + align - 1) & ~(uintptr_t)(align - 1);
+
+				RET_ON_ERR(ret > start + top || size > start + top - ret, nullptr, "[Stack Allocator] bottom allocation of %zu exceeds the %zu bytes left", size, available());
+
+				// round the size up so the next allocation stays aligned
+				bottom = ret - start + ((size + alignment - 1) & ~(alignment - 1));
+				if (bottom > top) // only the rounding spilled over
+					bottom = top;
+
+				return (void*)ret;
+			}
+
+			RET_ON_ERR(size > top, nullptr, "[Stack Allocator] top allocation of %zu exceeds the %zu bytes left", size, available());
+
+			uintptr_t ret = (start + top - size) & ~(uintptr_t)(align - 1);
+
+			RET_ON_ERR(ret < start + bottom, nullptr, "[Stack Allocator] top allocation of %zu exceeds the %zu bytes left", size, available());
+
+			top = ret - start;
+
+			return (void*)ret;
+		}
+
+		StackAllocator::Marker StackAllocator::getMarker(End end)
+		{
+			return end == End::Bottom ? bottom : top;
+		}
+
+		funcRet StackAllocator::freeToMarker(Marker marker, End end)
+		{
+			if (end == End::Bottom)
+			{
+				// a marker above the bottom end was already rolled past
+				RET_ON_ERR(marker > bottom, EXIT_FAILURE, "[Stack Allocator] bottom marker %zu is past the bottom end at %zu", marker, bottom);
+				bottom = marker;
+			}
+			else
+			{
+				// a marker below the top end was already rolled past
+				RET_ON_ERR(marker < top || marker > size, EXIT_FAILURE, "[Stack Allocator] top marker %zu is past the top end at %zu", marker, top);
+				top = marker;
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		void StackAllocator::clear(End end)
+		{
+			if (end == End::Bottom)
+				bottom = 0;
+			else
+				top = size;
+		}
+
+		size_t StackAllocator::available()
+		{
+			return top - bottom;
+		}
+	}
+}
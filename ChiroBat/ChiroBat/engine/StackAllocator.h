@@ -0,0 +1,65 @@
+#ifndef CHIROBAT_STACKALLOCATOR
+#define CHIROBAT_STACKALLOCATOR
+
+#include "Types.h"
+
+// a double-ended stack over one region from the memory manager, for data with strictly LIFO lifetimes
+// the bottom end and the top end grow towards each other, markers roll either end back in one step
+// not thread safe, each stack belongs to whoever is loading into it
+
+namespace ChiroBat
+{
+	namespace Memory
+	{
+		class StackAllocator
+		{
+		public:
+			enum class End : byte // which end of the stack to work with
+			{
+				Bottom, // grows up from the start of the region, meant for persistent data
+				Top // grows down from the end of the region, meant for temporary data
+			};
+
+			typedef size_t Marker; // a saved position of one end of the stack
+
+			StackAllocator();
+
+			// initialize the stack
+			// size - the bytes shared by both ends
+			funcRet init(size_t size);
+			funcRet shutDown(); // release the region
+
+			// allocate from one end of the stack
+			// size - the bytes requested
+			// end - the end to allocate from
+			void* malloc(size_t size, End end = End::Bottom);
+
+			// allocate aligned memory from one end of the stack
+			// size - the bytes requested
+			// align - the alignment, must be a power of 2
+			// end - the end to allocate from
+			void* alignMalloc(size_t size, size_t align, End end = End::Bottom);
+
+			Marker getMarker(End end); // save the current position of an end
+
+			// release everything allocated from an end since the marker was saved
+			// marker - a marker from getMarker for the same end
+			// end - the end to roll back
+			funcRet freeToMarker(Marker marker, End end);
+
+			void clear(End end); // release everything allocated from an end
+
+			size_t available(); // the bytes left between the two ends
+
+		private:
+			static constexpr size_t alignment = 16; // every allocation is kept at least this aligned
+
+			byte* region; // the memory both ends share
+			size_t size; // the bytes in the region
+			size_t bottom; // the offset the bottom end has grown to
+			size_t top; // the offset the top end has grown down to
+		};
+	}
+}
+
+#endif
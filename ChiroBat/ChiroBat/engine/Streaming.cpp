@@ -0,0 +1,523 @@
+#include <new>
+#include <string.h>
+#include "Streaming.h"
+#include "Memory.h"
+#include "Platform.h"
+#include "Debug.h"
+
+namespace ChiroBat
+{
+	namespace Streaming
+	{
+		uint64_t assetId(const char* name)
+		{
+			uint64_t ret = 14695981039346656037ull;
+
+			for (; *name; ++name)
+				ret = (ret ^ (byte)*name) * 1099511628211ull;
+
+			return ret;
+		}
+
+		// the length of a literal run or match, a nibble of 15 carries on in the bytes that follow
+		// in - the next byte to read, moved past the length
+		// end - the end of the packed data
+		// length - the nibble, grown by the bytes read
+		static funcRet readLength(const byte*& in, const byte* end, size_t& length)
+		{
+			if (length != 15)
+				return EXIT_SUCCESS;
+
+			byte more;
+			do
+			{
+				RET_ON_ERR(in == end, EXIT_FAILURE, "[Streaming] an LZ4 block ends inside a length");
+				more = *in++;
+				length += more;
+			} while (more == 255);
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet decompress(const byte* in, size_t inSize, byte* out, size_t outSize)
+		{
+			const byte* inEnd = in + inSize;
+			byte* at = out;
+			byte* outEnd = out + outSize;
+
+			while (in < inEnd)
+			{
+				byte token = *in++;
+
+				// the literals come first, copied as they are
+				size_t literals = token >> 4;
+				if (readLength(in, inEnd, literals))
+					return EXIT_FAILURE;
+
+				RET_ON_ERR(literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - at), EXIT_FAILURE, "[Streaming] an LZ4 block's literals run past its end");
+				memcpy(at, in, literals);
+				at += literals;
+				in += literals;
+
+				// the last sequence has no match
+				if (in == inEnd)
+					break;
+
+				RET_ON_ERR(inEnd - in < 2, EXIT_FAILURE, "[Streaming] an LZ4 block ends inside a match offset");
+				size_t offset = in[0] | (size_t)in[1] << 8;
+				in += 2;
+
+				size_t length = token & 15;
+				if (readLength(in, inEnd, length))
+					return EXIT_FAILURE;
+				length += 4; // the shortest match LZ4 encodes
+
+				RET_ON_ERR(!offset || offset > (size_t)(at - out), EXIT_FAILURE, "[Streaming] an LZ4 match points before the start of its block");
+				RET_ON_ERR(length > (size_t)(outEnd - at), EXIT_FAILURE, "[Streaming] an LZ4 match runs past the end of its block");
+
+				// a match may overlap the bytes it produces, a run of them repeats a pattern
+				const byte* match = at - offset;
+				if (offset >= length)
+					memcpy(at, match, length);
+				else
+					for (size_t i = 0; i < length; ++i)
+						at[i] = match[i];
+
+				at += length;
+			}
+
+			RET_ON_ERR(at != outEnd, EXIT_FAILURE, "[Streaming] an LZ4 block unpacked to %zu bytes, %zu were expected", (size_t)(at - out), outSize);
+
+			return EXIT_SUCCESS;
+		}
+
+		Streamer::Streamer() : archiveCount(0), slots(nullptr), freeSlots(noSlot), threads(nullptr), threadCount(0), stopping(false)
+		{
+		}
+
+		funcRet Streamer::init(size_t ioThreads)
+		{
+			// prevent over-initialization
+			RET_ON_ERR(slots, EXIT_FAILURE, "[Streaming] re-initialization of streaming was attempted");
+			RET_ON_ERR(!ioThreads, EXIT_FAILURE, "[Streaming] streaming needs at least one I/O thread");
+
+			slots = (Slot*)MEMORY.malloc(sizeof(Slot) * maxAssets, Memory::Tag::Streaming);
+			RET_ON_ERR(!slots, EXIT_FAILURE, "[Streaming] failed to allocate %zu asset slots", maxAssets);
+
+			threads = (std::thread*)MEMORY.malloc(sizeof(std::thread) * ioThreads, Memory::Tag::Streaming);
+			if (!threads)
+			{
+				MEMORY.free(slots, Memory::Tag::Streaming);
+				slots = nullptr;
+			}
+			RET_ON_ERR(!threads, EXIT_FAILURE, "[Streaming] failed to allocate %zu I/O threads", ioThreads);
+
+			// every slot starts on the free list, in order
+			for (uint32_t i = 0; i < maxAssets; ++i)
+			{
+				Slot* slot = new (slots + i) Slot();
+				slot->state.store(State::Failed, std::memory_order_relaxed);
+				slot->generation.store(0, std::memory_order_relaxed);
+				slot->next = i + 1 < maxAssets ? i + 1 : noSlot;
+			}
+			freeSlots = 0;
+
+			for (size_t i = 0; i < (size_t)Priority::Count; ++i)
+				heads[i] = tails[i] = noSlot;
+
+			stopping = false;
+			threadCount = ioThreads;
+			for (size_t i = 0; i < ioThreads; ++i)
+				new (threads + i) std::thread(&Streamer::work, this);
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet Streamer::shutDown()
+		{
+			// there is nothing to shut down if this is true
+			RET_ON_ERR(!slots, EXIT_FAILURE, "[Streaming] shutdown of non-initialized streaming was attempted");
+
+			// nothing queued is read now, the loads in flight are let finish
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				for (size_t i = 0; i < (size_t)Priority::Count; ++i)
+					while (heads[i] != noSlot)
+					{
+						slots[heads[i]].state.store(State::Cancelled, std::memory_order_release);
+						unqueue(heads[i]);
+					}
+
+				stopping = true;
+			}
+			queued.notify_all();
+			finished.notify_all();
+
+			for (size_t i = 0; i < threadCount; ++i)
+			{
+				threads[i].join();
+				threads[i].~thread();
+			}
+
+			MEMORY.free(threads, Memory::Tag::Streaming);
+			threads = nullptr;
+			threadCount = 0;
+
+			// the data of every load still held goes back with it
+			for (size_t i = 0; i < maxAssets; ++i)
+			{
+				if (slots[i].owned)
+					MEMORY.free((void*)slots[i].data, Memory::Tag::Streaming);
+
+				slots[i].~Slot();
+			}
+
+			MEMORY.free(slots, Memory::Tag::Streaming);
+			slots = nullptr;
+			freeSlots = noSlot;
+
+			for (size_t i = 0; i < archiveCount; ++i)
+				Platform::unmapFile(archives[i].data, archives[i].size);
+			archiveCount = 0;
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet Streamer::mount(const char* path)
+		{
+			RET_ON_ERR(!slots, EXIT_FAILURE, "[Streaming] %s was mounted before streaming was initialized", path);
+			RET_ON_ERR(archiveCount == maxArchives, EXIT_FAILURE, "[Streaming] %s was mounted past the limit of %zu archives", path, maxArchives);
+
+			size_t size;
+			const byte* data = (const byte*)Platform::mapFile(path, &size);
+			RET_ON_ERR(!data, EXIT_FAILURE, "[Streaming] failed to map archive %s", path);
+
+			// the header and every entry are checked once here, loads trust them after
+			const ArchiveHeader* header = (const ArchiveHeader*)data;
+			const ArchiveEntry* entries = (const ArchiveEntry*)(header + 1);
+
+			bool valid = size >= sizeof(ArchiveHeader) && header->magic == archiveMagic && header->version == archiveVersion &&
+				header->entryCount <= (size - sizeof(ArchiveHeader)) / sizeof(ArchiveEntry);
+
+			for (uint32_t i = 0; valid && i < header->entryCount; ++i)
+			{
+				const ArchiveEntry& entry = entries[i];
+				valid = entry.offset <= size && entry.packedSize <= size - entry.offset && (!i || entries[i - 1].id < entry.id) &&
+					(entry.compression == Compression::LZ4 || (entry.compression == Compression::Stored && entry.size == entry.packedSize));
+			}
+
+			if (!valid)
+				Platform::unmapFile(data, size);
+			RET_ON_ERR(!valid, EXIT_FAILURE, "[Streaming] %s is not a valid archive", path);
+
+			std::lock_guard<std::mutex> guard(lock);
+			archives[archiveCount++] = Archive{ data, size, entries, header->entryCount };
+
+			return EXIT_SUCCESS;
+		}
+
+		Asset Streamer::load(const char* name, Priority priority)
+		{
+			return load(assetId(name), priority);
+		}
+
+		Asset Streamer::load(uint64_t id, Priority priority)
+		{
+			RET_ON_ERR(!slots, noAsset, "[Streaming] an asset was loaded before streaming was initialized");
+			RET_ON_ERR(priority >= Priority::Count, noAsset, "[Streaming] an asset was loaded at invalid priority %d", (int)priority);
+
+			Asset ret;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				const byte* archive;
+				const ArchiveEntry* entry = findEntry(id, &archive);
+				RET_ON_ERR(!entry, noAsset, "[Streaming] asset %llx is in no mounted archive", (unsigned long long)id);
+				RET_ON_ERR(freeSlots == noSlot, noAsset, "[Streaming] all %zu asset slots are held", maxAssets);
+
+				uint32_t index = freeSlots;
+				Slot& slot = slots[index];
+				freeSlots = slot.next;
+
+				slot.entry = entry;
+				slot.archive = archive;
+				slot.data = nullptr;
+				slot.size = 0;
+				slot.owned = false;
+				slot.cancelling = false;
+				slot.releasing = false;
+				slot.priority = priority;
+				slot.state.store(State::Queued, std::memory_order_release);
+
+				// oldest first within a priority
+				slot.next = noSlot;
+				if (tails[(size_t)priority] != noSlot)
+					slots[tails[(size_t)priority]].next = index;
+				else
+					heads[(size_t)priority] = index;
+				tails[(size_t)priority] = index;
+
+				ret = Asset{ index, slot.generation.load(std::memory_order_relaxed) };
+			}
+			queued.notify_one();
+
+			return ret;
+		}
+
+		State Streamer::state(Asset asset)
+		{
+			Slot* slot = findSlot(asset);
+
+			return slot ? slot->state.load(std::memory_order_acquire) : State::Failed;
+		}
+
+		State Streamer::wait(Asset asset)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+
+			for (;;)
+			{
+				Slot* slot = findSlot(asset);
+				if (!slot)
+					return State::Failed;
+
+				State ret = slot->state.load(std::memory_order_acquire);
+				if (ret != State::Queued && ret != State::Loading)
+					return ret;
+
+				finished.wait(guard);
+			}
+		}
+
+		const void* Streamer::data(Asset asset, size_t* size)
+		{
+			Slot* slot = findSlot(asset);
+			if (!slot || slot->state.load(std::memory_order_acquire) != State::Ready)
+				return nullptr;
+
+			if (size)
+				*size = slot->size;
+
+			return slot->data;
+		}
+
+		funcRet Streamer::cancel(Asset asset)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				Slot* slot = findSlot(asset);
+				RET_ON_ERR(!slot, EXIT_FAILURE, "[Streaming] a released asset was cancelled");
+
+				State state = slot->state.load(std::memory_order_relaxed);
+				RET_ON_ERR(state != State::Queued && state != State::Loading, EXIT_FAILURE, "[Streaming] an asset that is not loading was cancelled");
+
+				// a load being read finishes first, its I/O thread drops the data
+				if (state == State::Loading)
+				{
+					slot->cancelling = true;
+					return EXIT_SUCCESS;
+				}
+
+				unqueue(asset.index);
+				slot->state.store(State::Cancelled, std::memory_order_release);
+			}
+			finished.notify_all();
+
+			return EXIT_SUCCESS;
+		}
+
+		funcRet Streamer::release(Asset asset)
+		{
+			bool queued;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				Slot* slot = findSlot(asset);
+				RET_ON_ERR(!slot, EXIT_FAILURE, "[Streaming] a released asset was released again");
+
+				State state = slot->state.load(std::memory_order_relaxed);
+
+				// a load being read finishes first, its I/O thread releases the slot
+				if (state == State::Loading)
+				{
+					slot->releasing = true;
+					return EXIT_SUCCESS;
+				}
+
+				queued = state == State::Queued;
+				if (queued)
+					unqueue(asset.index);
+
+				freeSlot(asset.index);
+			}
+
+			// a wait on a queued asset ends with it, as on a cancel
+			if (queued)
+				finished.notify_all();
+
+			return EXIT_SUCCESS;
+		}
+
+		Streamer::Slot* Streamer::findSlot(Asset asset)
+		{
+			if (!slots || asset.index >= maxAssets || slots[asset.index].generation.load(std::memory_order_relaxed) != asset.generation)
+				return nullptr;
+
+			return &slots[asset.index];
+		}
+
+		const ArchiveEntry* Streamer::findEntry(uint64_t id, const byte** archive)
+		{
+			for (size_t i = archiveCount; i--;)
+			{
+				const ArchiveEntry* entries = archives[i].entries;
+
+				// the entries are sorted by id
+				uint32_t low = 0;
+				uint32_t high = archives[i].entryCount;
+				while (low < high)
+				{
+					uint32_t middle = low + (high - low) / 2;
+					if (entries[middle].id < id)
+						low = middle + 1;
+					else
+						high = middle;
+				}
+
+				if (low < archives[i].entryCount && entries[low].id == id)
+				{
+					*archive = archives[i].data;
+					return &entries[low];
+				}
+			}
+
+			return nullptr;
+		}
+
+		void Streamer::unqueue(uint32_t index)
+		{
+			size_t priority = (size_t)slots[index].priority;
+
+			// cancels are rare and queues short, walk to the link that points at the slot
+			uint32_t previous = noSlot;
+			uint32_t* link = &heads[priority];
+			while (*link != index)
+			{
+				previous = *link;
+				link = &slots[*link].next;
+			}
+
+			*link = slots[index].next;
+			if (tails[priority] == index)
+				tails[priority] = previous;
+		}
+
+		void Streamer::freeSlot(uint32_t index)
+		{
+			Slot& slot = slots[index];
+
+			if (slot.owned)
+				MEMORY.free((void*)slot.data, Memory::Tag::Streaming);
+
+			slot.data = nullptr;
+			slot.owned = false;
+
+			// stale handles to the slot stop matching it
+			slot.generation.fetch_add(1, std::memory_order_relaxed);
+			slot.next = freeSlots;
+			freeSlots = index;
+		}
+
+		void Streamer::readAsset(Slot& slot)
+		{
+			PROFILE_SCOPE("Streaming::readAsset");
+
+			const ArchiveEntry* entry = slot.entry;
+			const byte* packed = slot.archive + entry->offset;
+
+			Platform::prefetchFile(packed, (size_t)entry->packedSize);
+
+			// a stored entry is used where it sits, its pages are touched here so the caller never faults on them
+			if (entry->compression == Compression::Stored)
+			{
+				byte touched = 0;
+				for (size_t i = 0; i < entry->size; i += Platform::pageSize())
+					touched ^= ((volatile const byte*)packed)[i];
+				(void)touched;
+
+				slot.data = packed;
+				slot.size = (size_t)entry->size;
+				return;
+			}
+
+			// a compressed entry unpacks straight into its buffer, nothing is staged in between
+			byte* data = (byte*)MEMORY.alignMalloc((size_t)entry->size, 16, Memory::Tag::Streaming);
+			if (!data)
+			{
+				LOG_ERR("[Streaming] failed to allocate %llu bytes for asset %llx", (unsigned long long)entry->size, (unsigned long long)entry->id);
+				return;
+			}
+
+			if (decompress(packed, (size_t)entry->packedSize, data, (size_t)entry->size))
+			{
+				MEMORY.free(data, Memory::Tag::Streaming);
+				return;
+			}
+
+			slot.data = data;
+			slot.size = (size_t)entry->size;
+			slot.owned = true;
+		}
+
+		void Streamer::work()
+		{
+			std::unique_lock<std::mutex> guard(lock);
+
+			for (;;)
+			{
+				// the most urgent queue with anything in it
+				size_t priority = 0;
+				while (priority < (size_t)Priority::Count && heads[priority] == noSlot)
+					++priority;
+
+				if (priority == (size_t)Priority::Count)
+				{
+					if (stopping)
+						return;
+
+					queued.wait(guard);
+					continue;
+				}
+
+				uint32_t index = heads[priority];
+				Slot& slot = slots[index];
+				unqueue(index);
+				slot.state.store(State::Loading, std::memory_order_release);
+
+				guard.unlock();
+				readAsset(slot);
+				guard.lock();
+
+				// a cancel or release that came in while reading drops the data
+				if (slot.cancelling || slot.releasing)
+				{
+					if (slot.owned)
+						MEMORY.free((void*)slot.data, Memory::Tag::Streaming);
+
+					slot.data = nullptr;
+					slot.owned = false;
+					slot.state.store(State::Cancelled, std::memory_order_release);
+				}
+				else
+					slot.state.store(slot.data ? State::Ready : State::Failed, std::memory_order_release);
+
+				if (slot.releasing)
+					freeSlot(index);
+
+				finished.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,204 @@
+#ifndef CHIROBAT_STREAMING
+#define CHIROBAT_STREAMING
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Types.h"
+#include "Patterns.h"
+
+#define STREAMING ChiroBat::Streaming::Streamer::instance()
+
+// asset streaming out of packed archives
+// an archive is mapped read-only as a whole, its entries are read straight out of the mapping
+// a stored entry is handed out where it sits in the mapping, nothing is copied
+// a compressed entry is decompressed from the mapping straight into a buffer from the memory manager
+// loads queue by priority and are served by a few I/O threads, which block on the page faults so the caller does not
+// a load returns a handle at once, poll its state or wait on it, and release it once done with the data
+//
+// the archive layout, little endian
+// Header - magic, version, entry count
+// Entry[count] - sorted by id, the id is assetId of the asset's name
+// the entries' data, each at the offset its entry gives from the start of the archive
+
+namespace ChiroBat
+{
+	namespace Streaming
+	{
+		static constexpr uint32_t archiveMagic = 0x4B504243; // "CBPK"
+		static constexpr uint32_t archiveVersion = 1; // the layout this engine reads
+
+		enum class Compression : uint32_t // how an entry's data is packed
+		{
+			Stored, // as is, read in place
+			LZ4 // an LZ4 block, without the frame
+		};
+
+		struct ArchiveHeader // the start of an archive
+		{
+			uint32_t magic; // archiveMagic
+			uint32_t version; // archiveVersion
+			uint32_t entryCount; // the entries following the header
+			uint32_t reserved; // 0
+		};
+
+		struct ArchiveEntry // an asset in an archive
+		{
+			uint64_t id; // assetId of the asset's name
+			uint64_t offset; // where the packed data starts, from the start of the archive
+			uint64_t packedSize; // the bytes of the packed data
+			uint64_t size; // the bytes of the data once unpacked
+			Compression compression; // how the data is packed
+			uint32_t reserved; // 0
+		};
+
+		enum class Priority : byte // which loads the I/O threads take first
+		{
+			Critical, // needed before the next frame
+			High, // needed soon, the level being entered
+			Normal, // the default
+			Background, // speculative, the level after
+			Count // the number of priorities, not a priority
+		};
+
+		enum class State : byte // how far a load has come
+		{
+			Queued, // waiting for an I/O thread
+			Loading, // being read
+			Ready, // the data can be used
+			Failed, // the asset could not be found or read
+			Cancelled // stopped before it was ready
+		};
+
+		struct Asset // a load in flight or done, stale once released
+		{
+			uint32_t index; // the load's slot
+			uint32_t generation; // the slot's use, bumped when the load is released
+		};
+
+		static constexpr Asset noAsset = { ~(uint32_t)0, 0 }; // never valid, returned when a load cannot be queued
+
+		// the id of an asset, the 64 bit FNV-1a hash of its name
+		// name - the asset's path within the archive
+		uint64_t assetId(const char* name);
+
+		// unpack an LZ4 block
+		// in - the packed data
+		// inSize - the bytes of packed data
+		// out - where to unpack to
+		// outSize - the bytes the data unpacks to, anything else is an error
+		funcRet decompress(const byte* in, size_t inSize, byte* out, size_t outSize);
+
+		class Streamer : public Patterns::Singleton<Streamer>
+		{
+		public:
+			static constexpr size_t maxArchives = 16; // the archives that can be mounted
+			static constexpr size_t maxAssets = 4096; // the loads that can be held at once
+
+			Streamer();
+
+			// start the I/O threads, the memory manager must be initialized with thread caches
+			// ioThreads - the I/O threads, a few keep the disk busy while others wait on page faults
+			funcRet init(size_t ioThreads = 2);
+			funcRet shutDown(); // cancel what is queued, finish what is loading, release every asset and archive
+
+			// map an archive, later archives are searched first so they can patch earlier ones
+			// path - the archive's file
+			funcRet mount(const char* path);
+
+			// queue a load
+			// name - the asset's path within the archives
+			// priority - how soon it is needed
+			// returns the load's handle, noAsset on failure
+			Asset load(const char* name, Priority priority = Priority::Normal);
+
+			// queue a load
+			// id - the asset's id
+			// priority - how soon it is needed
+			// returns the load's handle, noAsset on failure
+			Asset load(uint64_t id, Priority priority = Priority::Normal);
+
+			State state(Asset asset); // how far a load has come, Failed for a stale handle
+			State wait(Asset asset); // block until a load is no longer queued or loading, returns its state
+
+			// get a loaded asset's data, valid until it is released
+			// asset - the load
+			// size - set to the bytes of data, may be nullptr
+			// returns the data, nullptr unless the load is ready
+			const void* data(Asset asset, size_t* size = nullptr);
+
+			// stop a load, the handle stays valid and reads as cancelled
+			// asset - the load, it must be queued or loading
+			funcRet cancel(Asset asset);
+
+			// release a load and its data, the handle goes stale
+			// asset - the load, in any state
+			funcRet release(Asset asset);
+
+		private:
+			static constexpr uint32_t noSlot = ~(uint32_t)0; // the end of a slot list
+
+			struct Archive // a mounted archive
+			{
+				const byte* data; // the mapping
+				size_t size; // the bytes of the mapping
+				const ArchiveEntry* entries; // the entries, sorted by id
+				uint32_t entryCount; // the length of entries
+			};
+
+			struct Slot // a load
+			{
+				std::atomic<State> state; // how far the load has come
+				std::atomic<uint32_t> generation; // the slot's use
+				const ArchiveEntry* entry; // the entry being loaded
+				const byte* archive; // the start of the entry's archive
+				const void* data; // the data, in the mapping for stored entries
+				size_t size; // the bytes of data
+				bool owned; // true if data came from the memory manager
+				bool cancelling; // set while loading to drop the data once read
+				bool releasing; // set while loading to release the slot once read
+				Priority priority; // the queue the slot waits in
+				uint32_t next; // the next slot in its queue or the free list
+			};
+
+			Archive archives[maxArchives]; // the mounted archives, oldest first
+			size_t archiveCount; // the archives in use
+
+			Slot* slots; // every load, maxAssets long
+			uint32_t freeSlots; // the first unused slot
+			uint32_t heads[(size_t)Priority::Count]; // the oldest slot queued at each priority
+			uint32_t tails[(size_t)Priority::Count]; // the newest slot queued at each priority
+
+			std::thread* threads; // the I/O threads
+			size_t threadCount; // the length of threads
+			bool stopping; // set on shut down to release the I/O threads
+
+			std::mutex lock; // guards the archives, the queues, the free list, and the slots
+			std::condition_variable queued; // signalled when a load is queued
+			std::condition_variable finished; // signalled when a load leaves the loading state
+
+			// find the slot of a live handle, nullptr if it is stale
+			// asset - the handle
+			Slot* findSlot(Asset asset);
+
+			// find an entry in the mounted archives, newest archive first
+			// id - the asset's id
+			// archive - set to the start of the entry's archive
+			const ArchiveEntry* findEntry(uint64_t id, const byte** archive);
+
+			// take a slot off its queue, with the lock held
+			// index - the queued slot
+			void unqueue(uint32_t index);
+
+			// put a slot back on the free list, with the lock held
+			// index - the slot to release
+			void freeSlot(uint32_t index);
+
+			void readAsset(Slot& slot); // read a load's data, without the lock held, data is left nullptr on failure
+			void work(); // the loop of an I/O thread
+		};
+	}
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef CHIROBAT_TYPES
 #define CHIROBAT_TYPES
 
+#include <cstddef>
 #include <cstdint>
 
 namespace ChiroBat